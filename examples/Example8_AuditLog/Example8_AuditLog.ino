@@ -0,0 +1,143 @@
+/*
+  Using the SparkFun Cryptographic Co-processor Breakout ATECC508a (Qwiic)
+  By: SparkFun Electronics
+  Date: October 18th, 2026
+  License: This code is public domain but you can buy me a beer if you use this and we meet someday (Beerware license).
+
+  Feel like supporting our work? Please buy a board from SparkFun!
+  https://www.sparkfun.com/products/15573
+
+  This example shows how to keep a tamper-evident (hash-chained) event log.
+
+  Each log entry is hashed together with the hash of the entry before it:
+
+  chainHash = SHA256(previous chainHash || entry)
+
+  So adding an entry only costs one hash. If anybody changes, removes or reorders an entry later,
+  every chainHash after it changes too.
+
+  Every CHECKPOINT_ENTRIES entries (or every CHECKPOINT_MILLIS, whichever comes first),
+  we sign the current chainHash with the private key in slot 0. That signature anchors
+  the whole log (up to that point) in the secure element.
+
+  To audit the log offline, recompute the chain with any SHA-256 tool, starting from 32 bytes of zeros,
+  and check each checkpoint signature against the chainHash at that entry and this device's public key.
+
+  Here the "log" is just printed to the serial terminal. In your own project, you would append
+  each entry (and each checkpoint signature) to a file on an SD card.
+
+  Note, this requires that your device be configured with SparkFun Standard Configuration settings.
+  By default, this example uses the private key securely stored and locked in slot 0.
+
+  Hardware Connections and initial setup:
+  Install artemis in boards manager: http://boardsmanager/All#Sparkfun_artemis
+  Plug in your controller board (e.g. Artemis Redboard, Nano, ATP) into your computer with USB cable.
+  Connect your Cryptographic Co-processor to your controller board via a qwiic cable.
+  Select TOOLS>>BOARD>>"SparkFun Redboard Artemis"
+  Select TOOLS>>PORT>> "COM 3" (note, yours may be different)
+  Click upload, and follow along on serial monitor at 115200.
+
+*/
+
+#include <SparkFun_ATECCX08a_Arduino_Library.h> //Click here to get the library: http://librarymanager/All#SparkFun_ATECCX08a
+#include <Wire.h>
+
+ATECCX08A atecc;
+
+#define CHECKPOINT_ENTRIES 10 // sign the chain every 10 entries...
+#define CHECKPOINT_MILLIS 60000 // ...or every 60 seconds, whichever comes first
+
+uint8_t chainHash[32]; // starts as all zeros, then holds the hash of the latest entry
+unsigned long entryNumber = 0;
+unsigned long entriesSinceCheckpoint = 0;
+unsigned long lastCheckpoint = 0;
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+  if (atecc.begin() == true)
+  {
+    Serial.println("Successful wakeUp(). I2C connections are good.");
+  }
+  else
+  {
+    Serial.println("Device not found. Check wiring.");
+    while (1); // stall out forever
+  }
+
+  atecc.readConfigZone(false); // Debug argument false (OFF)
+
+  // check for configuration
+  if (!(atecc.configLockStatus && atecc.dataOTPLockStatus && atecc.slot0LockStatus))
+  {
+    Serial.print("Device not configured. Please use the configuration sketch.");
+    while (1); // stall out forever.
+  }
+
+  memset(chainHash, 0, sizeof(chainHash));
+  lastCheckpoint = millis();
+}
+
+void loop()
+{
+  // make up an event to log. In your project, this would be a sensor reading, a door opening, etc.
+  char entry[48];
+  snprintf(entry, sizeof(entry), "event %lu, uptime %lu ms", entryNumber, millis());
+
+  appendEntry((uint8_t *)entry, strlen(entry));
+
+  delay(1000);
+}
+
+void appendEntry(uint8_t *entry, size_t length)
+{
+  if (atecc.sha256Chain(chainHash, entry, length, chainHash) == false)
+  {
+    Serial.println("Failure to hash log entry");
+    return;
+  }
+
+  Serial.print("entry ");
+  Serial.print(entryNumber);
+  Serial.print(": ");
+  Serial.write(entry, length);
+  Serial.print("\tchain: ");
+  printBytes(chainHash, sizeof(chainHash));
+
+  entryNumber++;
+  entriesSinceCheckpoint++;
+
+  if ((entriesSinceCheckpoint >= CHECKPOINT_ENTRIES) || (millis() - lastCheckpoint >= CHECKPOINT_MILLIS))
+  {
+    checkpoint();
+  }
+}
+
+void checkpoint()
+{
+  // Sign the current head of the chain with the private key in slot 0.
+  // The signature will be available at atecc.signature[]
+  if (atecc.createSignature(chainHash) == false)
+  {
+    Serial.println("Failure to sign checkpoint");
+    return;
+  }
+
+  Serial.print("checkpoint at entry ");
+  Serial.print(entryNumber - 1);
+  Serial.print(": ");
+  printBytes(atecc.signature, sizeof(atecc.signature));
+
+  entriesSinceCheckpoint = 0;
+  lastCheckpoint = millis();
+}
+
+void printBytes(uint8_t *data, size_t length)
+{
+  for (size_t i = 0; i < length ; i++)
+  {
+    if ((data[i] >> 4) == 0) Serial.print("0"); // print preceeding high nibble if it's zero
+    Serial.print(data[i], HEX);
+  }
+  Serial.println();
+}
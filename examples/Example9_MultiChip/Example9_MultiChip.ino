@@ -0,0 +1,110 @@
+/*
+  Using the SparkFun Cryptographic Co-processor Breakout ATECC508a (Qwiic)
+  By: SparkFun Electronics
+  Date: October 18th, 2026
+  License: This code is public domain but you can buy me a beer if you use this and we meet someday (Beerware license).
+
+  Feel like supporting our work? Please buy a board from SparkFun!
+  https://www.sparkfun.com/products/15573
+
+  This example shows how to put several Cryptographic Co-processors on one I2C bus.
+
+  Every IC comes out of the box at the same address (0x60), so they can't all be connected at once.
+  Instead, we turn them on one at a time, and move each one to its own address before turning on the next.
+  Here each IC is powered from its own enable pin (ENABLE_PINS). An I2C mux works just as well.
+
+  Once they all have their own address, you can configure and lock each one (see Example1_Configuration,
+  using atecc.begin(address)), and then spread your signing load across them:
+  one ATECCX08A instance per IC, so N ICs can sign about N times as fast.
+
+  Note, the address can only be changed BEFORE the configuration zone is locked.
+  ICs that were already moved (e.g. on a second run of this sketch) are just found at their new address.
+
+  Hardware Connections and initial setup:
+  Install artemis in boards manager: http://boardsmanager/All#Sparkfun_artemis
+  Plug in your controller board (e.g. Artemis Redboard, Nano, ATP) into your computer with USB cable.
+  Connect your Cryptographic Co-processors to your controller board via qwiic cables,
+  with the power of each one switched by one of the ENABLE_PINS.
+  Select TOOLS>>BOARD>>"SparkFun Redboard Artemis"
+  Select TOOLS>>PORT>> "COM 3" (note, yours may be different)
+  Click upload, and follow along on serial monitor at 115200.
+
+*/
+
+#include <SparkFun_ATECCX08a_Arduino_Library.h> //Click here to get the library: http://librarymanager/All#SparkFun_ATECCX08a
+#include <Wire.h>
+
+#define CHIP_COUNT 3
+
+const uint8_t ENABLE_PINS[CHIP_COUNT] = {2, 3, 4}; // one per IC, HIGH = powered
+const uint8_t ADDRESSES[CHIP_COUNT] = {0x61, 0x62, 0x63}; // where each IC ends up, leaving 0x60 free for the next new one
+
+ATECCX08A atecc[CHIP_COUNT];
+
+void setup() {
+  Wire.begin();
+  Serial.begin(115200);
+
+  for (int i = 0 ; i < CHIP_COUNT ; i++)
+  {
+    pinMode(ENABLE_PINS[i], OUTPUT);
+    digitalWrite(ENABLE_PINS[i], LOW); // start with all of them off
+  }
+
+  for (int i = 0 ; i < CHIP_COUNT ; i++)
+  {
+    digitalWrite(ENABLE_PINS[i], HIGH); // turn on the next one. All the others are already at their own address.
+    delay(10);
+
+    Serial.print("IC ");
+    Serial.print(i);
+    Serial.print(": ");
+
+    if (atecc[i].begin(ADDRESSES[i]) == true)
+    {
+      Serial.println("already at its own address");
+    }
+    else if (atecc[i].begin(ATECC508A_ADDRESS_DEFAULT) == false)
+    {
+      Serial.println("not found. Check wiring.");
+    }
+    else if (atecc[i].setI2CAddress(ADDRESSES[i]) == true)
+    {
+      Serial.println("moved");
+    }
+    else
+    {
+      Serial.println("could not be moved (is the config zone locked already?)");
+    }
+
+    atecc[i].idleMode(); // begin() leaves it awake, and an IC that's awake ignores the next wake pulse
+  }
+
+  // Now they are all on the bus at once, let's see who's there, with a single wake.
+  // Only probe our own addresses, so discover() can put any IC that is still awake back into idle first.
+  ATECCX08A_DeviceInfo found[CHIP_COUNT];
+  uint8_t count = atecc[0].discover(found, CHIP_COUNT, Wire, ADDRESSES, CHIP_COUNT);
+
+  Serial.println();
+  Serial.print("Found ");
+  Serial.print(count);
+  Serial.println(" ICs:");
+
+  for (int i = 0 ; i < count ; i++)
+  {
+    Serial.print("0x");
+    Serial.print(found[i].address, HEX);
+    Serial.print("\tSerial Number: ");
+    for (int j = 0 ; j < 9 ; j++)
+    {
+      if ((found[i].serialNumber[j] >> 4) == 0) Serial.print("0"); // print preceeding high nibble if it's zero
+      Serial.print(found[i].serialNumber[j], HEX);
+    }
+    Serial.println();
+  }
+}
+
+void loop()
+{
+  // do nothing.
+}
@@ -48,7 +48,311 @@ boolean ATECCX08A::begin(uint8_t i2caddr, TwoWire &wirePort, Stream &serialPort)
 
   _i2caddr = i2caddr;
 
-  return ( wakeUp() ); // see if the IC wakes up properly, return responce.
+  _randomSeedUpdated = false; // assume a fresh power-up, so the next random draw will update the seed
+
+  invalidateCache(); // could be a different IC than last time
+
+  if (!acquireBus())
+    return false;
+
+  boolean result = wakeUp(); // see if the IC wakes up properly, return responce.
+
+  if (result && _busLock)
+    enterIdle(); // someone else may use the IC as soon as we let go of the lock
+
+  releaseBus();
+
+  return result;
+}
+
+/** \brief
+
+	beginPool(ATECCX08A *devices, uint8_t count, const uint8_t *addresses, TwoWire **wirePorts, boolean *ready)
+
+	Starts up several ICs at once, in about the time it takes to start one: the equivalent of begin(),
+	getInfo() and readConfigZone(false) on each of devices[0] to devices[count - 1].
+	Instead of one IC after the other, every step is sent to all of them first, then we wait
+	the execution time once, then collect all the responses:
+	- one wake pulse per bus (it wakes every IC on that bus)
+	- INFO to every IC, one wait, read all
+	- config block 0 to every IC, one wait, read all, and the same for blocks 1-3
+	An IC that fails any step is left out of the rest (and isn't ready), its configZone[]
+	may be half read then.
+
+	addresses[] holds the I2C address of each IC. wirePorts[] the bus each one is on
+	(NULL puts them all on Wire). If you pass ready[], it is set for each IC that made it all the way.
+	With setBusLock(), the lock is taken once per bus, by the first IC on it, and covers
+	the others on that bus too (so they can share one lock that isn't reentrant).
+	Returns the number of ICs that did. Any that didn't can be tried on their own with begin().
+*/
+
+uint8_t ATECCX08A::beginPool(ATECCX08A *devices, uint8_t count, const uint8_t *addresses, TwoWire **wirePorts, boolean *ready)
+{
+  static const uint16_t blocks[] = {ADDRESS_CONFIG_READ_BLOCK_0, ADDRESS_CONFIG_READ_BLOCK_1, ADDRESS_CONFIG_READ_BLOCK_2, ADDRESS_CONFIG_READ_BLOCK_3};
+  uint8_t readyCount = 0;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    ATECCX08A &device = devices[i];
+
+    device._i2cPort = wirePorts ? wirePorts[i] : &Wire;
+    #if defined(ARDUINO_ARCH_APOLLO3) || defined(ARDUINO_ARCH_ESP32)
+    device._debugSerial = &Serial;
+    #else
+    device._debugSerial = &SerialUSB;
+    #endif
+    device._i2caddr = addresses[i];
+    device._randomSeedUpdated = false;
+    device.invalidateCache();
+    device._poolBusOwner = NULL;
+
+    for (uint8_t j = 0; j < i && !device._poolBusOwner; j++)
+      if (devices[j]._i2cPort == device._i2cPort) device._poolBusOwner = &devices[j];
+
+    if (device._poolBusOwner)
+    {
+      device._poolReady = device._poolBusOwner->_poolReady; // the first IC on this bus holds the lock for all of them
+      device._busLocked = device._poolReady;
+    }
+    else
+      device._poolReady = device.acquireBus();
+  }
+
+  // one wake pulse per bus
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (!devices[i]._poolBusOwner && devices[i]._poolReady)
+    {
+      devices[i]._i2cPort->beginTransmission(0x00); // wake condition, see wakeUp()
+      devices[i]._i2cPort->endTransmission();
+    }
+  }
+
+  delayMicroseconds(1500); // tWHI, for all of them at once
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    ATECCX08A &device = devices[i];
+
+    if (!device._poolReady)
+      continue;
+
+    device.countGlobal = 0;
+    device.receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE);
+    device._poolReady = (device.checkCount() && device.checkCrc() && device.inputBuffer[RESPONSE_SIGNAL_INDEX] == ATRCC508A_SUCCESSFUL_WAKEUP);
+
+    if (device._poolReady)
+    {
+      device._awake = true;
+      device._wakeTime = millis();
+      device.setPowerState(POWER_STATE_ACTIVE);
+      device._sessionDepth++; // keeps it awake between the rounds below
+    }
+  }
+
+  // INFO
+  for (uint8_t i = 0; i < count; i++)
+    if (devices[i]._poolReady)
+      devices[i]._poolReady = devices[i].sendCommand(COMMAND_OPCODE_INFO, 0x00, 0x0000);
+
+  poolExecutionWait(devices, count, EXECUTION_TIME_INFO);
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    ATECCX08A &device = devices[i];
+
+    if (!device._poolReady)
+      continue;
+
+    device.countGlobal = 0;
+    device._poolReady = (device.receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_INFO_SIZE + CRC_SIZE) && device.checkCount() && device.checkCrc()
+                         && device.inputBuffer[RESPONSE_GETINFO_SIGNAL_INDEX] == ATRCC508A_SUCCESSFUL_GETINFO);
+
+    if (device._poolReady)
+    {
+      device._infoCached = true;
+      device._infoTime = millis();
+    }
+  }
+
+  // config zone, a block at a time, straight into configZone[] (only used once all 4 are in)
+  for (uint8_t block = 0; block < 4; block++)
+  {
+    for (uint8_t i = 0; i < count; i++)
+      if (devices[i]._poolReady)
+        devices[i]._poolReady = devices[i].sendCommand(COMMAND_OPCODE_READ, ZONE_CONFIG | 0b10000000, blocks[block]); // bit 7 set, 32 bytes
+
+    poolExecutionWait(devices, count, EXECUTION_TIME_READ);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+      ATECCX08A &device = devices[i];
+
+      if (!device._poolReady)
+        continue;
+
+      device.countGlobal = 0;
+      device._poolReady = (device.receiveResponseData(RESPONSE_COUNT_SIZE + CONFIG_ZONE_READ_SIZE + CRC_SIZE) && device.checkCount() && device.checkCrc());
+
+      if (device._poolReady)
+        memcpy(&device.configZone[CONFIG_ZONE_READ_SIZE * block], &device.inputBuffer[RESPONSE_READ_INDEX], CONFIG_ZONE_READ_SIZE);
+    }
+  }
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    ATECCX08A &device = devices[i];
+
+    if (device._poolReady)
+    {
+      device.useConfigZone(device.configZone);
+      readyCount++;
+    }
+
+    if (device._sessionDepth)
+    {
+      device._sessionDepth--;
+      device.enterIdle();
+    }
+
+    if (ready)
+      ready[i] = device._poolReady;
+  }
+
+  // let go of the bus locks only once every IC is idle
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (devices[i]._poolBusOwner)
+      devices[i]._busLocked = false; // borrowed, the owner unlocks it
+    else
+      devices[i].releaseBus();
+  }
+
+  return readyCount;
+}
+
+// executionWait() for every IC still on track in beginPool(), but with a single delay
+void ATECCX08A::poolExecutionWait(ATECCX08A *devices, uint8_t count, unsigned long ms)
+{
+  for (uint8_t i = 0; i < count; i++)
+    if (devices[i]._poolReady)
+      devices[i].trace(TRACE_PHASE_EXECUTE, true);
+
+  delay(ms);
+
+  for (uint8_t i = 0; i < count; i++)
+    if (devices[i]._poolReady)
+      devices[i].trace(TRACE_PHASE_EXECUTE, false);
+}
+
+/** \brief
+
+	discover(ATECCX08A_DeviceInfo *found, uint8_t maxFound, TwoWire &wirePort, const uint8_t *candidates, uint8_t candidateCount)
+
+	Finds every ATECC508A/608A on the bus, without having to guess addresses with begin().
+	A single wake pulse (to address 0x00) wakes all of them at once. Then each candidate address
+	gets one short read: only an ATECC answers with the wake response (0x04, 0x11 and a good CRC),
+	and an empty address NACKs right away, so probing the whole bus takes a few milliseconds.
+	The config zone block 0 of every IC found is read for its serial and revision number,
+	and they are all put back into idle mode.
+
+	By default every address from DISCOVER_FIRST_ADDRESS to DISCOVER_LAST_ADDRESS is probed.
+	Pass a candidate list to probe only those (and leave other devices on the bus alone).
+	ICs that are already awake (not asleep or idle) don't answer the wake pulse. With a candidate list,
+	each candidate gets the idle command first, so ICs left awake (e.g. by other instances) are found too.
+	A full scan doesn't write to unknown addresses, so call it at boot, or once the ICs have been idle
+	or asleep (their watchdog does that ATRCC508A_WATCHDOG_MS after a wake).
+	Returns how many were found (up to maxFound), in found[].
+	This instance keeps its own port and address (from begin()), whatever wirePort is scanned.
+*/
+
+uint8_t ATECCX08A::discover(ATECCX08A_DeviceInfo *found, uint8_t maxFound, TwoWire &wirePort, const uint8_t *candidates, uint8_t candidateCount)
+{
+  uint8_t count = 0;
+  uint8_t i2caddr = _i2caddr;
+  TwoWire *i2cPort = _i2cPort; // restored at the end, like the address
+  uint8_t response[RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE];
+  uint8_t block[CONFIG_ZONE_READ_SIZE];
+
+  if (!acquireBus())
+    return 0;
+
+  if (_awake)
+    enterIdle(); // so our own IC answers the wake pulse like the rest (on its own bus)
+
+  _i2cPort = &wirePort;
+
+  for (uint8_t i = 0; candidates && i < candidateCount; i++)
+  {
+    _i2cPort->beginTransmission(candidates[i]); // an IC that's awake goes idle, one that isn't just NACKs
+    _i2cPort->write(WORD_ADDRESS_VALUE_IDLE);
+    _i2cPort->endTransmission();
+  }
+
+  trace(TRACE_PHASE_WAKE, true);
+
+  _i2cPort->beginTransmission(0x00); // wake condition, for every IC on the bus (see wakeUp())
+  _i2cPort->endTransmission();
+
+  delayMicroseconds(1500);
+
+  trace(TRACE_PHASE_WAKE, false);
+
+  unsigned long wakeTime = millis();
+  uint8_t total = candidates ? candidateCount : (DISCOVER_LAST_ADDRESS - DISCOVER_FIRST_ADDRESS + 1);
+
+  for (uint8_t i = 0; i < total && count < maxFound; i++)
+  {
+    uint8_t address = candidates ? candidates[i] : DISCOVER_FIRST_ADDRESS + i;
+
+    // one try only, an ATECC that just woke up has its response ready
+    if (_i2cPort->requestFrom(address, (uint8_t)sizeof(response)) != sizeof(response))
+      continue;
+
+    for (uint8_t j = 0; j < sizeof(response) && _i2cPort->available(); j++)
+      response[j] = _i2cPort->read();
+
+    atca_calculate_crc(sizeof(response) - CRC_SIZE, response);
+
+    if (response[RESPONSE_COUNT_INDEX] != sizeof(response) || response[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_WAKEUP
+      || response[sizeof(response) - CRC_SIZE] != crc[0] || response[sizeof(response) - 1] != crc[1])
+      continue; // something else lives at this address
+
+    found[count++].address = address;
+  }
+
+  // They are all still awake from the same wake pulse, so read each one as if in a session
+  _sessionDepth++;
+
+  for (uint8_t i = 0; i < count; i++)
+  {
+    _i2caddr = found[i].address;
+    _awake = true;
+    _wakeTime = wakeTime;
+
+    if (read_output(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_0, CONFIG_ZONE_READ_SIZE, block, false))
+    {
+      memcpy(&found[i].serialNumber[0], &block[CONFIG_ZONE_SERIAL_PART0], 4); 	// copy SN<0:3>
+      memcpy(&found[i].serialNumber[4], &block[CONFIG_ZONE_SERIAL_PART1], 5); 	// copy SN<4:8>
+      memcpy(found[i].revisionNumber, &block[CONFIG_ZONE_REVISION_NUMBER], 4); 	// copy RevNum<0:3>
+    }
+    else
+    {
+      memset(found[i].serialNumber, 0, sizeof(found[i].serialNumber));
+      memset(found[i].revisionNumber, 0, sizeof(found[i].revisionNumber));
+    }
+
+    enterIdle();
+  }
+
+  _sessionDepth--;
+  _i2caddr = i2caddr;
+  _i2cPort = i2cPort;
+  _awake = false;
+
+  releaseBus();
+
+  return count;
 }
 
 /** \brief
@@ -66,10 +370,35 @@ boolean ATECCX08A::begin(uint8_t i2caddr, TwoWire &wirePort, Stream &serialPort)
 	Note, in most SparkFun Arduino Libraries, we would use a different
 	function called isConnected(), but because this IC will ACK and
 	respond with a status, we are gonna use wakeUp() for the same purpose.
+
+	If bus recovery pins have been set (see setBusRecoveryPins()), a failed wake
+	clears the bus and tries again with recoverBus(). sendCommand() does the same
+	when the command isn't acknowledged.
 */
 
 boolean ATECCX08A::wakeUp()
 {
+  if (wakePulse())
+    return true;
+
+  if (_sdaPin == BUS_RECOVERY_NO_PIN || _recovering)
+    return false;
+
+  return recoverBus();
+}
+
+boolean ATECCX08A::wakePulse()
+{
+  #ifdef ATECCX08A_FAULT_INJECTION
+  if (_faultHangWakes)
+  {
+    _faultHangWakes--; // injected, see setFaultInjection()
+    return false;
+  }
+  #endif
+
+  trace(TRACE_PHASE_WAKE, true);
+
   _i2cPort->beginTransmission(0x00); // set up to write to address "0x00",
   // This creates a "wake condition" where SDA is held low for at least tWLO
   // tWLO means "wake low duration" and must be at least 60 uSeconds (which is acheived by writing 0x00 at 100KHz I2C)
@@ -81,259 +410,421 @@ boolean ATECCX08A::wakeUp()
   // Now let's read back from the IC and see if it reports back good things.
   countGlobal = 0;
 
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
-    return false;
-
-  if (!checkCount() || !checkCrc())
-    return false;
+  receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE);
 
   // If we hear a "0x11", that means it had a successful wake up.
-  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_WAKEUP)
-    return false;
+  boolean result = (checkCount() && checkCrc() && inputBuffer[RESPONSE_SIGNAL_INDEX] == ATRCC508A_SUCCESSFUL_WAKEUP);
 
-  return true;
+  if (result)
+  {
+    if (millis() - _wakeTime > ATRCC508A_WATCHDOG_MS)
+      _randomSeedUpdated = false; // the watchdog has put it to sleep since the last wake, so the RNG seed is gone
+
+    _awake = true;
+    _wakeTime = millis();
+    setPowerState(POWER_STATE_ACTIVE);
+  }
+
+  trace(TRACE_PHASE_WAKE, false);
+
+  return result;
 }
 
 /** \brief
 
-	idleMode()
+	setBusRecoveryPins(uint8_t sdaPin, uint8_t sclPin)
 
-	The ATECCX08A goes into the idle mode and ignores all subsequent I/O transitions
-	until the next wake flag. The contents of TempKey and RNG Seed registers are retained.
-	Idle Power Supply Current: 800uA.
-	Note, it will automatically go into sleep mode after watchdog timer has been reached (1.3-1.7sec).
+	Tells the library which pins SDA and SCL are on, so it can clear a wedged bus by hand.
+	After a brownout or reset in the middle of a transfer, the IC can be left holding SDA low,
+	waiting for clocks that never come, and every call fails until a power cycle.
+	With the pins set, a wake or command write that fails runs recoverBus() and tries once more.
+
+	Restarting the I2C port with begin() puts it back to its default clock. If you changed it
+	with setClock(), pass the same clockSpeed here and recoverBus() sets it again.
 */
 
-void ATECCX08A::idleMode()
+void ATECCX08A::setBusRecoveryPins(uint8_t sdaPin, uint8_t sclPin, uint32_t clockSpeed)
 {
-  _i2cPort->beginTransmission(_i2caddr); // set up to write to address
-  _i2cPort->write(WORD_ADDRESS_VALUE_IDLE); // enter idle command (aka word address - the first part of every communication to the IC)
-  _i2cPort->endTransmission(); // actually send it
+  _sdaPin = sdaPin;
+  _sclPin = sclPin;
+  _busClock = clockSpeed;
 }
 
 /** \brief
 
-	getInfo()
+	recoverBus()
 
-	This function sends the INFO Command and listens for the correct version (0x50) within the response.
-	The Info command has a mode parameter, and in this function we are using the "Revision" mode (0x00)
-	At the time of data sheet creation the Info command will return 0x00 0x00 0x50 0x00. For
-	all versions of the ECC508A the 3rd byte will always be 0x50. The fourth byte will indicate the
-	silicon revision.
+	Stops the I2C port (so the pins are ours, not the I2C hardware's), clocks SCL
+	(up to BUS_RECOVERY_CLOCKS times) until SDA is released, sends a STOP,
+	and starts the I2C port again. Then it wakes the IC and checks it with getInfo().
+	The IC may have been reset along the way, so TempKey is treated as lost, and everything
+	remembered about the IC is forgotten (see invalidateCache()).
+	Returns true if the IC answered again, and leaves it awake (idle, if it has to let go of the bus lock).
+	Can be called by hand too (without recovery pins it just restarts the I2C port).
 */
 
-boolean ATECCX08A::getInfo()
+boolean ATECCX08A::recoverBus()
 {
-  if (!sendCommand(COMMAND_OPCODE_INFO, 0x00, 0x0000)) // param1 - 0x00 (revision mode).
+  unsigned long start = millis();
+
+  // the command we were in the middle of (if any) is still in progress, so don't lose track of it
+  uint8_t traceOpcode = _traceOpcode;
+  uint16_t traceParam2 = _traceParam2;
+  unsigned long commandStart = _commandStart;
+  uint8_t status = lastStatus;
+  boolean busHeld = _busLocked; // by the operation that called us, else let go of it when done
+
+  _recovering = true;
+
+  _i2cPort->end();
+  clearBus();
+  _i2cPort->begin();
+  if (_busClock)
+    _i2cPort->setClock(_busClock); // begin() went back to the default
+
+  _awake = false;
+  tempKeyValid = false;
+  _tempKeyEpoch++;
+  _randomSeedUpdated = false;
+  invalidateCache();
+
+  _sessionDepth++; // keep the IC awake after getInfo(), for whoever called us
+  boolean result = wakePulse() && getInfo();
+  _sessionDepth--;
+
+  if (!busHeld)
   {
-    return false;
+    if (result && _busLock)
+      enterIdle(); // someone else may use the IC as soon as we let go of the lock
+
+    releaseBus();
   }
 
-  delay(1); // time for IC to process command and exectute
+  _recovering = false;
 
-    // Now let's read back from the IC and see if it reports back good things.
-  countGlobal = 0;
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_INFO_SIZE + CRC_SIZE, true))
-    return false;
+  _traceOpcode = traceOpcode;
+  _traceParam2 = traceParam2;
+  _commandStart = commandStart;
+  lastStatus = status;
 
-  idleMode();
+  if (result)
+  {
+    busRecoveryCount++;
+    busRecoveryMillis += millis() - start;
+  }
+  else
+  {
+    busRecoveryFailures++;
+  }
 
-  if (!checkCount()|| !checkCrc())
-    return false;
+  return result;
+}
 
-  // If we hear a "0x50", that means it had a successful version response.
-  if (inputBuffer[RESPONSE_GETINFO_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_GETINFO)
-    return false;
+void ATECCX08A::clearBus()
+{
+  if (_sdaPin == BUS_RECOVERY_NO_PIN || _sclPin == BUS_RECOVERY_NO_PIN)
+    return;
 
-  return true;
+  // open drain by hand: drive low, or let the pull-up take the line high
+  pinMode(_sdaPin, INPUT_PULLUP);
+  pinMode(_sclPin, INPUT_PULLUP);
+  delayMicroseconds(5);
+
+  for (int i = 0; i < BUS_RECOVERY_CLOCKS && digitalRead(_sdaPin) == LOW; i++)
+  {
+    digitalWrite(_sclPin, LOW);
+    pinMode(_sclPin, OUTPUT);
+    delayMicroseconds(5); // ~100KHz
+    pinMode(_sclPin, INPUT_PULLUP);
+    delayMicroseconds(5);
+  }
+
+  // STOP condition: SDA goes high while SCL is high
+  digitalWrite(_sdaPin, LOW);
+  pinMode(_sdaPin, OUTPUT);
+  delayMicroseconds(5);
+  pinMode(_sdaPin, INPUT_PULLUP);
+  delayMicroseconds(5);
 }
 
 /** \brief
 
-	lockConfig()
+	idleMode()
 
-	This function sends the LOCK Command with the configuration zone parameter,
-	and listens for success response (0x00).
+	The ATECCX08A goes into the idle mode and ignores all subsequent I/O transitions
+	until the next wake flag. The contents of TempKey and RNG Seed registers are retained.
+	Idle Power Supply Current: 800uA.
+	Note, it will automatically go into sleep mode after watchdog timer has been reached (1.3-1.7sec).
+
+	Inside a session (see beginSession()), this does nothing, and the IC stays awake until endSession().
 */
 
-boolean ATECCX08A::lockConfig()
+void ATECCX08A::idleMode()
 {
-  return lock(LOCK_MODE_ZONE_CONFIG);
+  if (_sessionDepth)
+    return;
+
+  enterIdle();
+  releaseBus(); // end of a single command, taken in sendCommand()
+
+  endCommandSpan();
 }
 
 /** \brief
 
-	readConfigZone()
+	sleepMode()
 
-	This function reads the entire configuration zone EEPROM memory on the device.
-	It stores them for vewieing in a large array called configZone[128].
-	In addition to configuration settings, the configuration memory on the IC also
-	contains the serial number, revision number, lock statuses, and much more.
-	This function also updates global variables for these other things.
+	The ATECCX08A goes into sleep mode, its lowest power state (150nA). Unlike idle mode,
+	TempKey and the RNG seed are lost. Waking from sleep is also when the IC picks up
+	a new I2C address from its config zone (see setI2CAddress()).
+	Inside a session (see beginSession()), this does nothing.
 */
 
-boolean ATECCX08A::readConfigZone(boolean debug)
+void ATECCX08A::sleepMode()
 {
-  // read block 0, the first 32 bytes of config zone into inputBuffer
-  read(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_0, CONFIG_ZONE_READ_SIZE);
-
-  // copy current contents of inputBuffer into configZone[] (for later viewing/comparing)
-  memcpy(&configZone[CONFIG_ZONE_READ_SIZE * 0], &inputBuffer[1], CONFIG_ZONE_READ_SIZE);
+  if (_sessionDepth)
+    return;
 
-  read(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_1, CONFIG_ZONE_READ_SIZE); 	// read block 1
-  memcpy(&configZone[CONFIG_ZONE_READ_SIZE * 1], &inputBuffer[1], CONFIG_ZONE_READ_SIZE); 	// copy block 1
+  trace(TRACE_PHASE_SLEEP, true);
 
-  read(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_2, CONFIG_ZONE_READ_SIZE); 	// read block 2
-  memcpy(&configZone[CONFIG_ZONE_READ_SIZE * 2], &inputBuffer[1], CONFIG_ZONE_READ_SIZE); 	// copy block 2
-
-  read(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_3, CONFIG_ZONE_READ_SIZE); 	// read block 3
-  memcpy(&configZone[CONFIG_ZONE_READ_SIZE * 3], &inputBuffer[1], CONFIG_ZONE_READ_SIZE); 	// copy block 3
+  _i2cPort->beginTransmission(_i2caddr); // set up to write to address
+  _i2cPort->write(WORD_ADDRESS_VALUE_SLEEP); // enter sleep command (aka word address - the first part of every communication to the IC)
+  _i2cPort->endTransmission(); // actually send it
 
-  // pull out serial number from configZone, and copy to public variable within this instance
-  memcpy(&serialNumber[0], &configZone[CONFIG_ZONE_SERIAL_PART0], 4); 	// copy SN<0:3>
-  memcpy(&serialNumber[4], &configZone[CONFIG_ZONE_SERIAL_PART1], 5); 	// copy SN<4:8>
+  _awake = false;
+  tempKeyValid = false;
+  _tempKeyEpoch++;
+  _randomSeedUpdated = false; // the RNG seed is lost too
+  setPowerState(POWER_STATE_SLEEP);
 
-  // pull out revision number from configZone, and copy to public variable within this instance
-  memcpy(&revisionNumber[0], &configZone[CONFIG_ZONE_REVISION_NUMBER], 4); 	// copy RevNum<0:3>
+  trace(TRACE_PHASE_SLEEP, false);
 
-  // set lock statuses for config, data/otp, and slot 0
-  if (configZone[CONFIG_ZONE_LOCK_STATUS] == 0x00) configLockStatus = true;
-  else configLockStatus = false;
+  releaseBus();
 
-  if (configZone[CONFIG_ZONE_OTP_LOCK] == 0x00) dataOTPLockStatus = true;
-  else dataOTPLockStatus = false;
+  endCommandSpan();
+}
 
-  if ( (configZone[CONFIG_ZONE_SLOTS_LOCK0] & (1 << 0) ) == true) slot0LockStatus = false; // LSB is slot 0. if bit set = UN-locked.
-  else slot0LockStatus = true;
+void ATECCX08A::enterIdle()
+{
+  trace(TRACE_PHASE_IDLE, true);
 
-  memcpy(SlotConfig, &configZone[CONFIG_ZONE_SLOT_CONFIG], sizeof(uint16_t) * DATA_ZONE_SLOTS);
-  memcpy(KeyConfig, &configZone[CONFIG_ZONE_KEY_CONFIG], sizeof(uint16_t) * DATA_ZONE_SLOTS);
+  _i2cPort->beginTransmission(_i2caddr); // set up to write to address
+  _i2cPort->write(WORD_ADDRESS_VALUE_IDLE); // enter idle command (aka word address - the first part of every communication to the IC)
+  _i2cPort->endTransmission(); // actually send it
 
-  if (debug)
-  {
-    _debugSerial->println("configZone: ");
-    for (int i = 0; i < sizeof(configZone) ; i++)
-    {
-      _debugSerial->print(i);
-	  _debugSerial->print(": 0x");
-	  if ((configZone[i] >> 4) == 0) _debugSerial->print("0"); // print preceeding high nibble if it's zero
-	  _debugSerial->print(configZone[i], HEX);
-	  _debugSerial->print(" \t0b");
-	  for(int bit = 7; bit >= 0; bit--) _debugSerial->print(bitRead(configZone[i],bit)); // print binary WITH preceding '0' bits
-	  _debugSerial->println();
-    }
-    _debugSerial->println();
-  }
+  _awake = false;
+  setPowerState(POWER_STATE_IDLE);
 
-  return true;
+  trace(TRACE_PHASE_IDLE, false);
 }
 
 /** \brief
 
-	lockDataAndOTP()
+	beginSession()
 
-	This function sends the LOCK Command with the Data and OTP (one-time-programming) zone parameter,
-	and listens for success response (0x00).
+	Normally every command wakes the IC, and puts it back into idle mode once the response is in.
+	Between beginSession() and endSession(), the IC is woken once and then left awake, so a batch
+	of commands (e.g. load TempKey, then sign) are sent back-to-back without the wake/idle overhead.
+	If a session runs long, the IC is idled and woken again before the watchdog can put it to sleep,
+	so TempKey is kept.
+
+	Sessions can be nested; only the outermost endSession() puts the IC into idle mode.
+	Always pair every beginSession() with an endSession(), even if it returned false.
+
+	With a bus lock (see setBusLock()), the IC is always woken after taking the lock,
+	since another process may have put it into idle mode while we didn't hold it.
 */
 
-boolean ATECCX08A::lockDataAndOTP()
+boolean ATECCX08A::beginSession()
 {
-  return lock(LOCK_MODE_ZONE_DATA_AND_OTP);
-}
+  if (_sessionDepth++)
+    return true;
 
-/** \brief
+  _cancelRequested = false; // a new operation, forget any old cancel()
 
-	lockDataSlot0()
+  endCommandSpan(); // in case a single command before us never got to idleMode()
+  _traceOpcode = 0; // no command sent in this session yet
+  _traceParam2 = 0;
+  trace(TRACE_PHASE_SESSION, true);
 
-	This function sends the LOCK Command with the Slot 0 zone parameter,
-	and listens for success response (0x00).
-*/
+  boolean freshLock = (_busLock && !_busLocked); // our idea of the IC's state is stale after a gap in the lock
 
-boolean ATECCX08A::lockDataSlot0()
+  if (!acquireBus()) // held for the whole session
+    return false;
+
+  if (!freshLock && _awake && (millis() - _wakeTime <= ATRCC508A_SESSION_REWAKE_MS))
+    return true; // still awake (e.g. right after begin()), no need to wake it again
+
+  return wakeUp();
+}
+
+/** \brief
+
+	endSession()
+
+	Ends a session started with beginSession(), and puts the IC into idle mode.
+*/
+
+void ATECCX08A::endSession()
 {
-  return lock(LOCK_MODE_SLOT0);
+  if (_sessionDepth == 0)
+    return;
+
+  if (--_sessionDepth == 0)
+  {
+    if (!_busLock || _busLocked) // never touch the bus without the lock (e.g. if beginSession() couldn't get it)
+    {
+      enterIdle();
+      releaseBus();
+    }
+    trace(TRACE_PHASE_SESSION, false);
+  }
 }
 
 /** \brief
 
-	lock(byte zone)
+	setBusLock(boolean (*lock)(void *context), void (*unlock)(void *context), void *context)
 
-	This function sends the LOCK Command using the argument zone as parameter 1,
-	and listens for success response (0x00).
+	If more than one process (or RTOS task) talks to the IC on the same I2C bus, their commands and
+	responses can interleave and corrupt each other. Give the library a lock, and it will hold it
+	for each complete operation: a single command from send to idle, or a whole session (e.g. load TempKey + sign).
+
+	lock() should block until the bus is free, and return false if it could not get it (e.g. a timeout).
+	On Linux, flock(fd, LOCK_EX) on a shared lock file is a good fit. context is passed to both callbacks.
+	Pass NULL to go back to no locking (the default, which costs a single pointer check per operation).
+
+	busLockCount and busLockMicros keep track of how often, and for how long, we waited for the lock,
+	so you can check that it doesn't dominate short commands.
 */
 
-boolean ATECCX08A::lock(uint8_t zone)
+void ATECCX08A::setBusLock(boolean (*lock)(void *context), void (*unlock)(void *context), void *context)
 {
-  if (!sendCommand(COMMAND_OPCODE_LOCK, zone, 0x0000))
+  _busLock = lock;
+  _busUnlock = unlock;
+  _busLockContext = context;
+}
+
+boolean ATECCX08A::acquireBus()
+{
+  if (!_busLock || _busLocked)
+    return true;
+
+  unsigned long start = micros();
+
+  if (!_busLock(_busLockContext))
     return false;
 
-  delay(32); // time for IC to process command and exectute
+  busLockMicros += micros() - start;
+  busLockCount++;
+  _busLocked = true;
 
-  // Now let's read back from the IC and see if it reports back good things.
-  countGlobal = 0;
+  return true;
+}
 
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
+void ATECCX08A::releaseBus()
+{
+  if (!_busLocked)
+    return;
+
+  _busLocked = false;
+
+  if (_busUnlock)
+    _busUnlock(_busLockContext);
+}
+
+/** \brief
+
+	getInfo()
+
+	This function sends the INFO Command and listens for the correct version (0x50) within the response.
+	The Info command has a mode parameter, and in this function we are using the "Revision" mode (0x00)
+	At the time of data sheet creation the Info command will return 0x00 0x00 0x50 0x00. For
+	all versions of the ECC508A the 3rd byte will always be 0x50. The fourth byte will indicate the
+	silicon revision.
+
+	Calls that come in within ATRCC508A_COALESCE_MS of a successful one share its result,
+	so a burst of callers (e.g. several tasks at boot) costs a single INFO command.
+*/
+
+boolean ATECCX08A::getInfo()
+{
+  if (_infoCached && (millis() - _infoTime < ATRCC508A_COALESCE_MS))
+    return true;
+
+  if (!sendCommand(COMMAND_OPCODE_INFO, 0x00, 0x0000)) // param1 - 0x00 (revision mode).
+  {
+    return false;
+  }
+
+  executionWait(EXECUTION_TIME_INFO); // time for IC to process command and exectute
+
+    // Now let's read back from the IC and see if it reports back good things.
+  countGlobal = 0;
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_INFO_SIZE + CRC_SIZE, true))
     return false;
 
   idleMode();
 
-  if (!checkCount() || !checkCrc())
+  if (!checkCount()|| !checkCrc())
     return false;
 
-  // If we hear a "0x00", that means it had a successful lock
-  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_LOCK)
+  // If we hear a "0x50", that means it had a successful version response.
+  if (inputBuffer[RESPONSE_GETINFO_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_GETINFO)
     return false;
 
+  _infoCached = true;
+  _infoTime = millis();
+
   return true;
 }
 
 /** \brief
 
-	updateRandom32Bytes(boolean debug)
+	lockConfig()
 
-    This function pulls a complete random number (all 32 bytes)
-    It stores it in a global array called random32Bytes[]
-    If you wish to access this global variable and use as a 256 bit random number,
-    then you will need to access this array and combine it's elements as you wish.
-    In order to keep compatibility with ATmega328 based arduinos,
-    We have offered some other functions that return variables more usable (i.e. byte, int, long)
-    They are getRandomByte(), getRandomInt(), and getRandomLong().
+	This function sends the LOCK Command with the configuration zone parameter,
+	and listens for success response (0x00).
 */
 
-boolean ATECCX08A::updateRandom32Bytes(boolean debug)
+boolean ATECCX08A::lockConfig()
 {
-  if (!sendCommand(COMMAND_OPCODE_RANDOM, 0x00, 0x0000))
-    return false;
+  return lock(LOCK_MODE_ZONE_CONFIG);
+}
 
-  // param1 = 0. - Automatically update EEPROM seed only if necessary prior to random number generation. Recommended for highest security.
-  // param2 = 0x0000. - must be 0x0000.
+/** \brief
 
-  delay(23); // time for IC to process command and exectute
+	readConfigZone()
 
-  // Now let's read back from the IC. This will be 35 bytes of data (count + 32_data_bytes + crc[0] + crc[1])
+	This function reads the entire configuration zone EEPROM memory on the device.
+	It stores them for vewieing in a large array called configZone[128].
+	In addition to configuration settings, the configuration memory on the IC also
+	contains the serial number, revision number, lock statuses, and much more.
+	This function also updates global variables for these other things.
 
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_RANDOM_SIZE + CRC_SIZE, debug))
-    return false;
+	Returns false if any of the reads failed, in which case the global variables are left as they were.
 
-  idleMode();
+	Once the config and data zones are both locked, the config zone can no longer change
+	(apart from slot locks, which lock() takes care of), so later calls are answered from
+	memory without any bus traffic. See invalidateCache().
+*/
 
-  if (!checkCount(debug) || !checkCrc(debug))
+boolean ATECCX08A::readConfigZone(boolean debug)
+{
+  if (!_configZoneCached && !readConfigZoneFromDevice())
     return false;
 
-  // update random32Bytes[] array
-  // we don't need the count value (which is currently the first byte of the inputBuffer)
-  for (int i = 0 ; i < RESPONSE_RANDOM_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
-  {
-    random32Bytes[i] = inputBuffer[RESPONSE_COUNT_SIZE + i];
-  }
-
   if (debug)
   {
-    _debugSerial->print("random32Bytes: ");
-    for (int i = 0; i < sizeof(random32Bytes) ; i++)
+    _debugSerial->println("configZone: ");
+    for (int i = 0; i < sizeof(configZone) ; i++)
     {
-      _debugSerial->print(random32Bytes[i], HEX);
-      _debugSerial->print(",");
+      _debugSerial->print(i);
+	  _debugSerial->print(": 0x");
+	  if ((configZone[i] >> 4) == 0) _debugSerial->print("0"); // print preceeding high nibble if it's zero
+	  _debugSerial->print(configZone[i], HEX);
+	  _debugSerial->print(" \t0b");
+	  for(int bit = 7; bit >= 0; bit--) _debugSerial->print(bitRead(configZone[i],bit)); // print binary WITH preceding '0' bits
+	  _debugSerial->println();
     }
     _debugSerial->println();
   }
@@ -341,795 +832,2762 @@ boolean ATECCX08A::updateRandom32Bytes(boolean debug)
   return true;
 }
 
+boolean ATECCX08A::readConfigZoneFromDevice()
+{
+  byte newConfigZone[CONFIG_ZONE_SIZE];
+  boolean result;
+
+  beginSession(); // all 4 reads in one wake
+
+  // read the 4 blocks of 32 bytes straight into a scratch copy, so a failed read can't leave configZone[] half updated
+  result = (read_output(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_0, CONFIG_ZONE_READ_SIZE, &newConfigZone[CONFIG_ZONE_READ_SIZE * 0]) && commandBoundary() &&
+            read_output(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_1, CONFIG_ZONE_READ_SIZE, &newConfigZone[CONFIG_ZONE_READ_SIZE * 1]) && commandBoundary() &&
+            read_output(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_2, CONFIG_ZONE_READ_SIZE, &newConfigZone[CONFIG_ZONE_READ_SIZE * 2]) && commandBoundary() &&
+            read_output(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_3, CONFIG_ZONE_READ_SIZE, &newConfigZone[CONFIG_ZONE_READ_SIZE * 3]));
+
+  endSession();
+  _cancelRequested = false; // a late cancel() is forgotten, see cancel()
+
+  if (!result)
+    return false;
+
+  useConfigZone(newConfigZone);
+
+  return true;
+}
+
+void ATECCX08A::useConfigZone(const uint8_t *newConfigZone)
+{
+  // copy into configZone[] (for later viewing/comparing)
+  if (newConfigZone != configZone)
+    memcpy(configZone, newConfigZone, CONFIG_ZONE_SIZE);
+
+  // pull out serial number from configZone, and copy to public variable within this instance
+  memcpy(&serialNumber[0], &configZone[CONFIG_ZONE_SERIAL_PART0], 4); 	// copy SN<0:3>
+  memcpy(&serialNumber[4], &configZone[CONFIG_ZONE_SERIAL_PART1], 5); 	// copy SN<4:8>
+
+  // pull out revision number from configZone, and copy to public variable within this instance
+  memcpy(&revisionNumber[0], &configZone[CONFIG_ZONE_REVISION_NUMBER], 4); 	// copy RevNum<0:3>
+
+  // set lock statuses for config, data/otp, and slot 0
+  if (configZone[CONFIG_ZONE_LOCK_STATUS] == 0x00) configLockStatus = true;
+  else configLockStatus = false;
+
+  if (configZone[CONFIG_ZONE_OTP_LOCK] == 0x00) dataOTPLockStatus = true;
+  else dataOTPLockStatus = false;
+
+  if ( (configZone[CONFIG_ZONE_SLOTS_LOCK0] & (1 << 0) ) == true) slot0LockStatus = false; // LSB is slot 0. if bit set = UN-locked.
+  else slot0LockStatus = true;
+
+  memcpy(SlotConfig, &configZone[CONFIG_ZONE_SLOT_CONFIG], sizeof(uint16_t) * DATA_ZONE_SLOTS);
+  memcpy(KeyConfig, &configZone[CONFIG_ZONE_KEY_CONFIG], sizeof(uint16_t) * DATA_ZONE_SLOTS);
+
+  _configZoneCached = (configLockStatus && dataOTPLockStatus);
+}
+
 /** \brief
 
-	getRandomByte(boolean debug)
+	invalidateCache()
 
-    This function returns a random byte.
-	It calls updateRandom32Bytes(), then uses the first byte in that array for a return value.
+	Forgets the results that getInfo(), readConfigZone() and generatePublicKey() remember,
+	so the next call asks the IC again. The library does this itself after write(), lock()
+	and createNewKeyPair(). Call it if something else (another instance, another program) may
+	have changed the device.
 */
 
-byte ATECCX08A::getRandomByte(boolean debug)
+void ATECCX08A::invalidateCache()
 {
-  updateRandom32Bytes(debug);
-  return random32Bytes[0];
+  _infoCached = false;
+  _configZoneCached = false;
+  _publicKeyCacheSlot = PUBLIC_KEY_CACHE_EMPTY;
 }
 
 /** \brief
 
-	getRandomInt(boolean debug)
+	saveBootCache(ATECCX08A_BootCache *cache)
 
-    This function returns a random Int.
-	It calls updateRandom32Bytes(), then uses the first 2 bytes in that array for a return value.
-	It bitwize ORS the first two bytes of the array into the return value.
+	Fills cache with what the library knows about the IC: the whole config zone (serial and revision
+	number, lock status, SlotConfig[], KeyConfig[]) and the public key generatePublicKey() remembered, if any.
+	Store it in your own non-volatile memory (EEPROM, flash, a file), and hand it to restoreBootCache()
+	on the next boot, to skip readConfigZone() (4 READs) and generatePublicKey() (a 115ms GENKEY).
+
+	Call readConfigZone() (and generatePublicKey(), if you want the key kept too) first.
+	Returns false if the config and data zones aren't both locked yet. Until then the config
+	can still change underneath a cache, so it isn't worth saving.
 */
 
-int ATECCX08A::getRandomInt(boolean debug)
+boolean ATECCX08A::saveBootCache(ATECCX08A_BootCache *cache)
 {
-  updateRandom32Bytes(debug);
-  int return_val;
-  return_val = random32Bytes[0]; // store first randome byte into return_val
-  return_val <<= 8; // shift it over, to make room for the next byte
-  return_val |= random32Bytes[1]; // "or in" the next byte in the array
-  return return_val;
+  if (!_configZoneCached)
+    return false;
+
+  memset(cache, 0, sizeof(ATECCX08A_BootCache));
+  cache->magic = BOOT_CACHE_MAGIC;
+  cache->address = _i2caddr;
+  memcpy(cache->configZone, configZone, CONFIG_ZONE_SIZE);
+  cache->publicKeySlot = _publicKeyCacheSlot;
+  if (_publicKeyCacheSlot != PUBLIC_KEY_CACHE_EMPTY)
+    memcpy(cache->publicKey, _publicKeyCache, PUBLIC_KEY_SIZE);
+
+  atca_calculate_crc(offsetof(ATECCX08A_BootCache, crc), (uint8_t *)cache);
+  memcpy(cache->crc, crc, CRC_SIZE);
+
+  return true;
 }
 
 /** \brief
 
-	getRandomLong(boolean debug)
+	restoreBootCache(const ATECCX08A_BootCache *cache)
 
-    This function returns a random Long.
-	It calls updateRandom32Bytes(), then uses the first 4 bytes in that array for a return value.
-	It bitwize ORS the first 4 bytes of the array into the return value.
+	Call right after begin(). Checks that cache (from saveBootCache()) is intact, and belongs to
+	this very IC, with a single 32 byte READ of config block 0 (serial number, revision, address
+	and the first SlotConfigs). If it matches, the config zone variables (configZone[], serialNumber[],
+	lock status, etc.) and the cached public key are loaded from it, and readConfigZone() and
+	generatePublicKey() are answered from memory from then on.
+
+	Only caches of ICs with locked config and data zones are accepted. Those only leave the
+	SlotLocked bytes (88-89) free to change (a slot can still be locked later), so they are
+	read fresh with one 4 byte READ instead of being taken from the cache.
+	Returns false if the cache doesn't match (e.g. the board got a different IC), in which case
+	nothing is loaded. Do the slow readConfigZone() and generatePublicKey() then, and save a new cache.
 */
 
-long ATECCX08A::getRandomLong(boolean debug)
+boolean ATECCX08A::restoreBootCache(const ATECCX08A_BootCache *cache)
 {
-  updateRandom32Bytes(debug);
-  long return_val;
-  return_val = random32Bytes[0]; // store first randome byte into return_val
-  return_val <<= 8; // shift it over, to make room for the next byte
-  return_val |= random32Bytes[1]; // "or in" the next byte in the array
-  return_val <<= 8; // shift it over, to make room for the next byte
-  return_val |= random32Bytes[2]; // "or in" the next byte in the array
-  return_val <<= 8; // shift it over, to make room for the next byte
-  return_val |= random32Bytes[3]; // "or in" the next byte in the array
-  return return_val;
+  uint8_t block[CONFIG_ZONE_READ_SIZE];
+  uint8_t slotLocks[4];
+  uint8_t newConfigZone[CONFIG_ZONE_SIZE];
+
+  if (cache->magic != BOOT_CACHE_MAGIC || cache->address != _i2caddr)
+    return false;
+
+  atca_calculate_crc(offsetof(ATECCX08A_BootCache, crc), (uint8_t *)cache);
+  if (memcmp(cache->crc, crc, CRC_SIZE) != 0)
+    return false; // corrupted in storage
+
+  if (cache->configZone[CONFIG_ZONE_LOCK_STATUS] != 0x00 || cache->configZone[CONFIG_ZONE_OTP_LOCK] != 0x00)
+    return false; // not locked, can't be trusted
+
+  beginSession(); // still awake from begin(), so no need to wake it again
+  boolean result = (read_output(ZONE_CONFIG, ADDRESS_CONFIG_READ_BLOCK_0, CONFIG_ZONE_READ_SIZE, block) &&
+                    read_output(ZONE_CONFIG, EEPROM_CONFIG_ADDRESS(CONFIG_ZONE_SLOTS_LOCK0), 4, slotLocks)); // word 22, SlotLocked and ChipOptions
+  endSession();
+
+  if (!result || memcmp(block, cache->configZone, CONFIG_ZONE_READ_SIZE) != 0)
+    return false; // not the same IC
+
+  memcpy(newConfigZone, cache->configZone, CONFIG_ZONE_SIZE);
+  newConfigZone[CONFIG_ZONE_SLOTS_LOCK0] = slotLocks[0]; // may have been locked since the cache was saved
+  newConfigZone[CONFIG_ZONE_SLOTS_LOCK1] = slotLocks[1];
+  useConfigZone(newConfigZone);
+
+  if (cache->publicKeySlot != PUBLIC_KEY_CACHE_EMPTY && publicKeyFixed(cache->publicKeySlot))
+  {
+    memcpy(_publicKeyCache, cache->publicKey, PUBLIC_KEY_SIZE);
+    memcpy(publicKey64Bytes, cache->publicKey, PUBLIC_KEY_SIZE);
+    _publicKeyCacheSlot = cache->publicKeySlot;
+  }
+
+  return true;
 }
 
 /** \brief
 
-	random(long max)
+	keyType(uint8_t slot)
 
-    This function returns a positive random Long between 0 and max
-	max can be up to the larges positive value of a long: 2147483647
+	Returns the KeyConfig.KeyType of a slot (KEY_TYPE_ECC, KEY_TYPE_AES or KEY_TYPE_SHA).
+	Uses KeyConfig[], so call readConfigZone() first.
 */
 
-long ATECCX08A::random(long max)
+uint8_t ATECCX08A::keyType(uint8_t slot)
 {
-  return random(0, max);
+  if (slot >= DATA_ZONE_SLOTS)
+    return 0;
+
+  return KEY_CONFIG_GET(KeyConfig[slot], KEY_CONFIG_OFFSET_KEY_TYPE, 0b111);
 }
 
 /** \brief
 
-	random(long min, long max)
+	eccPrivateKeySlots()
 
-    This function returns a random Long with set boundaries of min and max.
-	If you flip min and max, it still works!
-	Also, it can handle negative numbers. Wahoo!
+	Returns a bit mask of the slots that are configured to hold an ECC private key (bit 0 = slot 0).
+	Together with publicKeySlots(), this is an inventory of signing keys on the device, built from
+	the config zone that is already in memory, so it costs no extra commands.
 */
 
-long ATECCX08A::random(long min, long max)
+uint16_t ATECCX08A::eccPrivateKeySlots()
 {
-  long randomLong = getRandomLong();
-  long halfFSR = (max - min) / 2; // half of desired full scale range
-  long midPoint = (max + min) / 2; // where we "start" out output value, then add in a fraction of halfFSR
-  float fraction = float(randomLong) / 2147483647;
-  return (midPoint + (halfFSR * fraction) );
+  uint16_t slots = 0;
+
+  for (int i = 0; i < DATA_ZONE_SLOTS; i++)
+  {
+    if (keyType(i) == KEY_TYPE_ECC && KEY_CONFIG_GET(KeyConfig[i], KEY_CONFIG_OFFSET_PRIVATE, 1))
+      slots |= (1 << i);
+  }
+
+  return slots;
 }
 
 /** \brief
 
-	receiveResponseData(uint8_t length, boolean debug)
+	publicKeySlots()
 
-	This function receives messages from the ATECCX08a IC (up to 128 Bytes)
-	It will return true if it receives the correct amount of data and good CRCs.
-	What we hear back from the IC is always formatted with the following series of bytes:
-	COUNT, DATA, CRC[0], CRC[1]
-	Note, the count number includes itself, the num of data bytes, and the two CRC bytes in the total,
-	so a simple response message from the IC that indicates that it heard the wake
-	condition properly is like so:
-	EXAMPLE Wake success response: 0x04, 0x11, 0x33, 0x44
-	It needs length argument:
-	length: length of data to receive (includes count + DATA + 2 crc bytes)
+	Returns a bit mask of the ECC private key slots that allow their public key to be
+	generated with generatePublicKey() (KeyConfig.PubInfo set).
 */
-boolean ATECCX08A::receiveResponseData(uint8_t length, boolean debug)
+
+uint16_t ATECCX08A::publicKeySlots()
 {
+  uint16_t slots = 0;
+  uint16_t privateSlots = eccPrivateKeySlots();
 
-  // pull in data 32 bytes at at time. (necessary to avoid overflow on atmega328)
-  // if length is less than or equal to 32, then just pull it in.
-  // if length is greater than 32, then we must first pull in 32, then pull in remainder.
-  // lets use length as our tracker and we will subtract from it as we pull in data.
-  countGlobal = 0; // reset for each new message (most important, like wensleydale at a cheese party)
-  cleanInputBuffer();
-  byte requestAttempts = 0; // keep track of how many times we've attempted to request, to break out if necessary
+  for (int i = 0; i < DATA_ZONE_SLOTS; i++)
+  {
+    if ((privateSlots & (1 << i)) && KEY_CONFIG_GET(KeyConfig[i], KEY_CONFIG_OFFSET_PUB_INFO, 1))
+      slots |= (1 << i);
+  }
 
-  /* Normalize length according to buffer size */
-  if (length > sizeof(inputBuffer))
-    length = sizeof(inputBuffer);
+  return slots;
+}
 
-  while(length)
-  {
-    byte requestAmount; // amount of bytes to request, needed to pull in data 32 bytes at a time
-    if (length > ATRCC508A_MAX_REQUEST_SIZE)
-    {
-      requestAmount = ATRCC508A_MAX_REQUEST_SIZE; // as we have more than 32 to pull in, keep pulling in 32 byte chunks
-    }
-    else
+/** \brief
+
+	lockDataAndOTP()
+
+	This function sends the LOCK Command with the Data and OTP (one-time-programming) zone parameter,
+	and listens for success response (0x00).
+*/
+
+boolean ATECCX08A::lockDataAndOTP()
+{
+  return lock(LOCK_MODE_ZONE_DATA_AND_OTP);
+}
+
+/** \brief
+
+	lockDataSlot0()
+
+	This function sends the LOCK Command with the Slot 0 zone parameter,
+	and listens for success response (0x00).
+*/
+
+boolean ATECCX08A::lockDataSlot0()
+{
+  return lock(LOCK_MODE_SLOT0);
+}
+
+/** \brief
+
+	lock(byte zone)
+
+	This function sends the LOCK Command using the argument zone as parameter 1,
+	and listens for success response (0x00).
+*/
+
+boolean ATECCX08A::lock(uint8_t zone)
+{
+  invalidateCache(); // lock status bits are about to change
+
+  if (!sendCommand(COMMAND_OPCODE_LOCK, zone, 0x0000))
+    return false;
+
+  executionWait(EXECUTION_TIME_LOCK); // time for IC to process command and exectute
+
+  // Now let's read back from the IC and see if it reports back good things.
+  countGlobal = 0;
+
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
+    return false;
+
+  idleMode();
+
+  if (!checkCount() || !checkCrc())
+    return false;
+
+  // If we hear a "0x00", that means it had a successful lock
+  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_LOCK)
+    return false;
+
+  return true;
+}
+
+/** \brief
+
+	updateRandom32Bytes(boolean debug)
+
+    This function pulls a complete random number (all 32 bytes)
+    It stores it in a global array called random32Bytes[]
+    If you wish to access this global variable and use as a 256 bit random number,
+    then you will need to access this array and combine it's elements as you wish.
+    In order to keep compatibility with ATmega328 based arduinos,
+    We have offered some other functions that return variables more usable (i.e. byte, int, long)
+    They are getRandomByte(), getRandomInt(), and getRandomLong().
+*/
+
+boolean ATECCX08A::updateRandom32Bytes(boolean debug)
+{
+  uint8_t mode = randomMode();
+
+  if (!sendCommand(COMMAND_OPCODE_RANDOM, mode, 0x0000))
+    return false;
+
+  // param1 = 0. - Automatically update EEPROM seed only if necessary prior to random number generation. Recommended for highest security.
+  // param1 = 1. - Use the existing seed, no EEPROM write. See setRandomSeedPolicy().
+  // param2 = 0x0000. - must be 0x0000.
+
+  executionWait(EXECUTION_TIME_RANDOM); // time for IC to process command and exectute
+
+  // Now let's read back from the IC. This will be 35 bytes of data (count + 32_data_bytes + crc[0] + crc[1])
+
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_RANDOM_SIZE + CRC_SIZE, debug))
+    return false;
+
+  idleMode();
+
+  if (!checkCount(debug) || !checkCrc(debug))
+    return false;
+
+  if (mode == RANDOM_MODE_SEED_UPDATE)
+    _randomSeedUpdated = true;
+
+  // update random32Bytes[] array
+  // we don't need the count value (which is currently the first byte of the inputBuffer)
+  for (int i = 0 ; i < RESPONSE_RANDOM_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
+  {
+    random32Bytes[i] = inputBuffer[RESPONSE_COUNT_SIZE + i];
+  }
+
+  if (debug)
+  {
+    _debugSerial->print("random32Bytes: ");
+    for (int i = 0; i < sizeof(random32Bytes) ; i++)
     {
-      requestAmount = length; // now we're ready to pull in the last chunk.
+      _debugSerial->print(random32Bytes[i], HEX);
+      _debugSerial->print(",");
     }
+    _debugSerial->println();
+  }
+
+  return true;
+}
 
-    uint32_t ret = _i2cPort->requestFrom(_i2caddr, requestAmount);    // request bytes from slave
+/** \brief
 
-    requestAttempts++;
+	setRandomSeedPolicy(uint8_t policy)
 
-    while (_i2cPort->available())   // slave may send less than requested
+	Chooses when the RANDOM command is allowed to update the RNG seed stored in EEPROM.
+	RANDOM_SEED_UPDATE_ALWAYS (default): every draw may update the seed. Recommended for highest security.
+	RANDOM_SEED_UPDATE_ONCE: only the first successful draw after each wake from sleep updates the seed,
+	later draws skip the EEPROM write. Use this when you need a lot of random numbers,
+	so the EEPROM doesn't wear out. The IC loses its RNG seed whenever it sleeps (sleepMode(),
+	a bus recovery, or the watchdog 1.3-1.7sec after a wake), so the library keeps track of that,
+	and updates the seed again on the next draw.
+*/
+
+void ATECCX08A::setRandomSeedPolicy(uint8_t policy)
+{
+  _randomSeedPolicy = policy;
+}
+
+/** \brief
+
+	randomMode()
+
+	Returns the RANDOM (and random NONCE) mode to use for the next draw, according to the seed policy.
+*/
+
+uint8_t ATECCX08A::randomMode()
+{
+  if (millis() - _wakeTime > ATRCC508A_WATCHDOG_MS)
+    _randomSeedUpdated = false; // the command will find it asleep (watchdog), seed lost
+
+  if (_randomSeedPolicy == RANDOM_SEED_UPDATE_ONCE && _randomSeedUpdated)
+    return RANDOM_MODE_NO_SEED_UPDATE;
+
+  return RANDOM_MODE_SEED_UPDATE;
+}
+
+/** \brief
+
+	getRandomByte(boolean debug)
+
+    This function returns a random byte.
+	It calls updateRandom32Bytes(), then uses the first byte in that array for a return value.
+*/
+
+byte ATECCX08A::getRandomByte(boolean debug)
+{
+  updateRandom32Bytes(debug);
+  return random32Bytes[0];
+}
+
+/** \brief
+
+	getRandomInt(boolean debug)
+
+    This function returns a random Int.
+	It calls updateRandom32Bytes(), then uses the first 2 bytes in that array for a return value.
+	It bitwize ORS the first two bytes of the array into the return value.
+*/
+
+int ATECCX08A::getRandomInt(boolean debug)
+{
+  updateRandom32Bytes(debug);
+  int return_val;
+  return_val = random32Bytes[0]; // store first randome byte into return_val
+  return_val <<= 8; // shift it over, to make room for the next byte
+  return_val |= random32Bytes[1]; // "or in" the next byte in the array
+  return return_val;
+}
+
+/** \brief
+
+	getRandomLong(boolean debug)
+
+    This function returns a random Long.
+	It calls updateRandom32Bytes(), then uses the first 4 bytes in that array for a return value.
+	It bitwize ORS the first 4 bytes of the array into the return value.
+*/
+
+long ATECCX08A::getRandomLong(boolean debug)
+{
+  updateRandom32Bytes(debug);
+  long return_val;
+  return_val = random32Bytes[0]; // store first randome byte into return_val
+  return_val <<= 8; // shift it over, to make room for the next byte
+  return_val |= random32Bytes[1]; // "or in" the next byte in the array
+  return_val <<= 8; // shift it over, to make room for the next byte
+  return_val |= random32Bytes[2]; // "or in" the next byte in the array
+  return_val <<= 8; // shift it over, to make room for the next byte
+  return_val |= random32Bytes[3]; // "or in" the next byte in the array
+  return return_val;
+}
+
+/** \brief
+
+	random(long max)
+
+    This function returns a positive random Long between 0 and max
+	max can be up to the larges positive value of a long: 2147483647
+*/
+
+long ATECCX08A::random(long max)
+{
+  return random(0, max);
+}
+
+/** \brief
+
+	random(long min, long max)
+
+    This function returns a random Long with set boundaries of min and max.
+	If you flip min and max, it still works!
+	Also, it can handle negative numbers. Wahoo!
+*/
+
+long ATECCX08A::random(long min, long max)
+{
+  long randomLong = getRandomLong();
+  long halfFSR = (max - min) / 2; // half of desired full scale range
+  long midPoint = (max + min) / 2; // where we "start" out output value, then add in a fraction of halfFSR
+  float fraction = float(randomLong) / 2147483647;
+  return (midPoint + (halfFSR * fraction) );
+}
+
+/** \brief
+
+	setRandomPool(uint8_t *buffer, uint8_t size)
+
+	Gives the random pool (see refillRandomPool() and tryGetRandom()) a buffer of size bytes to live in.
+	Only a power of 2 (up to RANDOM_POOL_MAX_SIZE) is used, so e.g. 100 bytes give a 64 byte pool.
+	Call it before any interrupt takes bytes out of the pool, it starts out empty.
+	Pass NULL to go without a pool again.
+*/
+
+void ATECCX08A::setRandomPool(uint8_t *buffer, uint8_t size)
+{
+  uint8_t poolSize = 0;
+
+  if (buffer)
+    for (poolSize = RANDOM_POOL_MAX_SIZE; poolSize > size; poolSize >>= 1); // largest power of 2 that fits
+
+  _randomPoolHead = 0; // empty
+  _randomPoolTail = 0;
+  _randomPool = buffer;
+  _randomPoolSize = poolSize;
+}
+
+/** \brief
+
+	refillRandomPool(boolean debug)
+
+	Tops up the random pool (see setRandomPool()) with fresh bytes from updateRandom32Bytes().
+	Call this from your main loop (never from an interrupt, it talks to the IC and takes ~23ms per 32 bytes).
+	Returns false if the IC did not answer, in which case the pool keeps whatever it already had,
+	or if there is no pool.
+*/
+
+boolean ATECCX08A::refillRandomPool(boolean debug)
+{
+  boolean result = true;
+
+  if (!_randomPoolSize)
+    return false;
+
+  beginSession();
+
+  while (randomPoolAvailable() < _randomPoolSize)
+  {
+    if (!updateRandom32Bytes(debug))
     {
-      uint8_t value = _i2cPort->read();
+      result = false;
+      break;
+    }
 
-      /* Make sure not to read beyond buffer size */
-      if (countGlobal < sizeof(inputBuffer))
-        inputBuffer[countGlobal] = value;    // receive a byte as character
+    for (int i = 0; i < RANDOM_BYTES_BLOCK_SIZE && randomPoolAvailable() < _randomPoolSize; i++)
+    {
+      uint8_t head = _randomPoolHead;
+      _randomPool[head & (_randomPoolSize - 1)] = random32Bytes[i];
+      _randomPoolHead = head + 1; // publish the byte only after it has been written
+    }
 
-      length--; // keep this while loop active until we've pulled in everything
-      countGlobal++; // keep track of the count of the entire message.
+    if (!commandBoundary())
+    {
+      result = false;
+      break;
     }
+  }
 
-    if (requestAttempts == ATRCC508A_MAX_RETRIES)
-      break; // this probably means that the device is not responding.
+  endSession();
+  _cancelRequested = false; // a late cancel() is forgotten, see cancel()
+
+  return result;
+}
+
+/** \brief
+
+	tryGetRandom(uint8_t *value)
+
+	Takes one random byte out of the pool, without blocking and without touching the I2C bus,
+	so it is safe to call inside an interrupt (e.g. for a radio backoff value).
+	Returns false if the pool is empty; call refillRandomPool() from your main loop to keep it stocked.
+	Only one interrupt (or task) should take bytes out of the pool at a time.
+*/
+
+boolean ATECCX08A::tryGetRandom(uint8_t *value)
+{
+  uint8_t tail = _randomPoolTail;
+
+  if (tail == _randomPoolHead)
+    return false; // empty
+
+  *value = _randomPool[tail & (_randomPoolSize - 1)];
+  _randomPoolTail = tail + 1; // hand the slot back to the producer only after reading it
+
+  return true;
+}
+
+/** \brief
+
+	randomPoolAvailable()
+
+	Returns how many random bytes are currently waiting in the pool.
+*/
+
+uint8_t ATECCX08A::randomPoolAvailable()
+{
+  return (uint8_t)(_randomPoolHead - _randomPoolTail);
+}
+
+/** \brief
+
+	receiveResponseData(uint8_t length, boolean debug)
+
+	This function receives messages from the ATECCX08a IC (up to 128 Bytes)
+	It will return true if it receives the correct amount of data and good CRCs.
+	What we hear back from the IC is always formatted with the following series of bytes:
+	COUNT, DATA, CRC[0], CRC[1]
+	Note, the count number includes itself, the num of data bytes, and the two CRC bytes in the total,
+	so a simple response message from the IC that indicates that it heard the wake
+	condition properly is like so:
+	EXAMPLE Wake success response: 0x04, 0x11, 0x33, 0x44
+	It needs length argument:
+	length: length of data to receive (includes count + DATA + 2 crc bytes)
+*/
+boolean ATECCX08A::receiveResponseData(uint8_t length, boolean debug)
+{
+
+  // pull in data 32 bytes at at time. (necessary to avoid overflow on atmega328)
+  // if length is less than or equal to 32, then just pull it in.
+  // if length is greater than 32, then we must first pull in 32, then pull in remainder.
+  // lets use length as our tracker and we will subtract from it as we pull in data.
+  trace(TRACE_PHASE_READ, true);
+
+  countGlobal = 0; // reset for each new message (most important, like wensleydale at a cheese party)
+  cleanInputBuffer();
+  byte requestAttempts = 0; // keep track of how many times we've attempted to request, to break out if necessary
+
+  #ifdef ATECCX08A_FAULT_INJECTION
+  if (_faults)
+    injectFaults();
+  #endif
+
+  /* Normalize length according to buffer size */
+  if (length > sizeof(inputBuffer))
+    length = sizeof(inputBuffer);
+
+  _responseLength = length; // for checkCount()
+
+  while(length)
+  {
+    byte requestAmount; // amount of bytes to request, needed to pull in data 32 bytes at a time
+    if (length > ATRCC508A_MAX_REQUEST_SIZE)
+    {
+      requestAmount = ATRCC508A_MAX_REQUEST_SIZE; // as we have more than 32 to pull in, keep pulling in 32 byte chunks
+    }
+    else
+    {
+      requestAmount = length; // now we're ready to pull in the last chunk.
+    }
+
+    #ifdef ATECCX08A_FAULT_INJECTION
+    if (_faultNackPolls)
+    {
+      _faultNackPolls--; // injected, see setFaultInjection()
+      delayMicroseconds(FAULT_NACK_US);
+    }
+    else
+    #endif
+    {
+      _i2cPort->requestFrom(_i2caddr, requestAmount);    // request bytes from slave
+    }
+
+    requestAttempts++;
+
+    while (_i2cPort->available())   // slave may send less than requested
+    {
+      uint8_t value = _i2cPort->read();
+
+      /* Make sure not to read beyond buffer size */
+      if (countGlobal < sizeof(inputBuffer))
+        inputBuffer[countGlobal] = value;    // receive a byte as character
+
+      length--; // keep this while loop active until we've pulled in everything
+      countGlobal++; // keep track of the count of the entire message.
+    }
+
+    if (requestAttempts == ATRCC508A_MAX_RETRIES)
+      break; // this probably means that the device is not responding.
+
+    if (_deadlineSet && (long)(millis() - _deadline) > 0)
+    {
+      lastStatus = ATECC_STATUS_TIMEOUT; // no point retrying any more
+      break;
+    }
+  }
+
+  #ifdef ATECCX08A_FAULT_INJECTION
+  if (_faultCorrupt)
+    corruptResponse();
+  #endif
+
+  if (debug)
+  {
+    _debugSerial->print("inputBuffer: ");
+    for (int i = 0; i < countGlobal ; i++)
+    {
+      _debugSerial->print(inputBuffer[i], HEX);
+      _debugSerial->print(",");
+    }
+    _debugSerial->println();
+  }
+
+  if (_commandTiming)
+  {
+    _commandTiming = false;
+
+    uint8_t index = opcodeIndex(_traceOpcode);
+    unsigned long latency = micros() - _commandStart;
+
+    if (index < OPCODE_INDEX_COUNT && _latencyHistograms[index])
+      _latencyHistograms[index]->record(latency);
+
+    if (index < OPCODE_INDEX_COUNT && _energyStats)
+    {
+      _energyStats->commandMicros[index] += latency;
+      _energyStats->commandCount[index]++;
+    }
+  }
+
+  trace(TRACE_PHASE_READ, false);
+
+  return true;
+}
+
+/** \brief
+
+	checkCount(boolean debug)
+
+	This function checks that the count byte received in the most recent message equals countGlobal
+	Call receiveResponseData, and then imeeditately call this to check the count of the complete message.
+	Returns true if inputBuffer[0] == countGlobal.
+	A status-only packet (count 4 and a good CRC over those 4 bytes) where data was asked for means
+	the command failed on the IC; that returns false too, with lastStatus set to ATECC_STATUS_EXEC_ERROR.
+*/
+
+boolean ATECCX08A::checkCount(boolean debug)
+{
+  if (debug)
+  {
+    _debugSerial->print("countGlobal: 0x");
+	_debugSerial->println(countGlobal, HEX);
+	_debugSerial->print("count heard from IC (inpuBuffer[0]): 0x");
+    _debugSerial->println(inputBuffer[0], HEX);
+  }
+
+  // A failed command only sends count, status and CRC, and Wire pads the rest of what we asked for
+  const uint8_t statusLength = RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE;
+  if (_responseLength > statusLength && countGlobal >= statusLength && inputBuffer[RESPONSE_COUNT_INDEX] == statusLength)
+  {
+	atca_calculate_crc(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE, inputBuffer);
+	if (memcmp(&inputBuffer[RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE], crc, CRC_SIZE) == 0)
+	{
+	  if (lastStatus == ATECC_STATUS_OK) lastStatus = ATECC_STATUS_EXEC_ERROR;
+	  if (debug) _debugSerial->println("Execution Error");
+	  return false;
+	}
+  }
+
+  // Check count; the first byte sent from IC is count, and it should be equal to the actual message count
+  if (inputBuffer[RESPONSE_COUNT_INDEX] != countGlobal)
+  {
+	if (lastStatus == ATECC_STATUS_OK) lastStatus = ATECC_STATUS_COMM_ERROR;
+	if (debug) _debugSerial->println("Message Count Error");
+	  return false;
+  }
+
+  return true;
+}
+
+/** \brief
+
+	checkCrc(boolean debug)
+
+	This function checks that the CRC bytes received in the most recent message equals a calculated CRCs
+	Call receiveResponseData, then call immediately call this to check the CRCs of the complete message.
+*/
+
+boolean ATECCX08A::checkCrc(boolean debug)
+{
+  trace(TRACE_PHASE_CRC, true);
+
+  // Check CRC[0] and CRC[1] are good to go.
+  atca_calculate_crc(countGlobal - CRC_SIZE, inputBuffer);   // first calculate it
+
+  trace(TRACE_PHASE_CRC, false);
+
+  if (debug)
+  {
+    _debugSerial->print("CRC[0] Calc: 0x");
+	_debugSerial->println(crc[0], HEX);
+	_debugSerial->print("CRC[1] Calc: 0x");
+    _debugSerial->println(crc[1], HEX);
+  }
+
+  if ( (inputBuffer[countGlobal - (CRC_SIZE - 1)] != crc[1]) || (inputBuffer[countGlobal - CRC_SIZE] != crc[0]) )   // then check the CRCs.
+  {
+	if (lastStatus == ATECC_STATUS_OK) lastStatus = ATECC_STATUS_COMM_ERROR;
+	if (debug) _debugSerial->println("Message CRC Error");
+	  return false;
+  }
+
+  return true;
+}
+
+/** \brief
+
+	atca_calculate_crc(uint8_t length, uint8_t *data)
+
+    This function calculates CRC.
+    It was copied directly from the App Note provided from Microchip.
+    Note, it seems to be their own unique type of CRC cacluation.
+    View the entire app note here:
+    http://ww1.microchip.com/downloads/en/AppNotes/Atmel-8936-CryptoAuth-Data-Zone-CRC-Calculation-ApplicationNote.pdf
+    \param[in] length number of bytes in buffer
+    \param[in] data pointer to data for which CRC should be calculated
+*/
+
+void ATECCX08A::atca_calculate_crc(uint8_t length, uint8_t *data)
+{
+  uint8_t counter;
+  uint16_t crc_register = 0;
+  uint16_t polynom = 0x8005;
+  uint8_t shift_register;
+  uint8_t data_bit, crc_bit;
+  for (counter = 0; counter < length; counter++) {
+    for (shift_register = 0x01; shift_register > 0x00; shift_register <<= 1) {
+      data_bit = (data[counter] & shift_register) ? 1 : 0;
+      crc_bit = crc_register >> 15;
+      crc_register <<= 1;
+      if (data_bit != crc_bit)
+        crc_register ^= polynom;
+    }
+  }
+  crc[0] = (uint8_t) (crc_register & 0x00FF);
+  crc[1] = (uint8_t) (crc_register >> 8);
+}
+
+
+/** \brief
+
+	cleanInputBuffer()
+
+    This function sets the entire inputBuffer to 0xFFs.
+	It is helpful for debugging message/count/CRCs errors.
+*/
+
+void ATECCX08A::cleanInputBuffer()
+{
+  for (int i = 0; i < sizeof(inputBuffer) ; i++)
+  {
+    inputBuffer[i] = 0xFF;
+  }
+}
+
+/** \brief
+
+	createNewKeyPair(uint16_t slot)
+
+    This function sends the command to create a new key pair (private AND public)
+	in the slot designated by argument slot (default slot 0).
+	Sparkfun Default Configuration Sketch calls this, and then locks the data/otp zones and slot 0.
+*/
+
+boolean ATECCX08A::createNewKeyPair(uint16_t slot)
+{
+  invalidateCache(); // the old public key of this slot is no longer any good
+
+  if (!sendCommand(COMMAND_OPCODE_GENKEY, GENKEY_MODE_NEW_PRIVATE, slot))
+    return false;
+
+  executionWait(EXECUTION_TIME_GENKEY); // time for IC to process command and exectute
+
+  // Now let's read back from the IC.
+
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + PUBLIC_KEY_SIZE + CRC_SIZE)) // public key (64), plus crc (2), plus count (1)
+    return false;
+
+  idleMode();
+
+  // update publicKey64Bytes[] array
+  if (!checkCount() || !checkCrc()) // check that it was a good message
+    return false;
+
+  // we don't need the count value (which is currently the first byte of the inputBuffer)
+  for (int i = 0 ; i < PUBLIC_KEY_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
+  {
+    publicKey64Bytes[i] = inputBuffer[i + RESPONSE_COUNT_SIZE];
+  }
+
+  return true;
+}
+
+/** \brief
+
+	generatePublicKey(uint16_t slot, boolean debug)
+
+    This function uses the GENKEY command in "Public Key Computation" mode.
+
+    Generates an ECC public key based upon the private key stored in the slot defined by the KeyID
+	parameter (aka slot). Defaults to slot 0.
+
+	Note, if you haven't created a private key in the slot already, then this will fail.
+
+	The generated public key is read back from the device, and then copied from inputBuffer to
+	a global variable named publicKey64Bytes for later use.
+
+	Once the private key can't change any more (the slot is locked, or the config and data zones
+	are locked and SlotConfig doesn't allow GenKey or PrivWrite), the key is remembered and
+	asking for the same slot again needs no GENKEY.
+*/
+
+boolean ATECCX08A::generatePublicKey(uint16_t slot, boolean debug)
+{
+  if (slot == _publicKeyCacheSlot)
+  {
+    memcpy(publicKey64Bytes, _publicKeyCache, PUBLIC_KEY_SIZE); // same key as last time, no need for another 115ms GENKEY
+  }
+  else if (!generatePublicKeyFromDevice(slot))
+  {
+    return false;
+  }
+
+  if (debug)
+  {
+    _debugSerial->println("This device's Public Key:");
+    _debugSerial->println();
+    _debugSerial->println("uint8_t publicKey[64] = {");
+    for (int i = 0; i < sizeof(publicKey64Bytes) ; i++)
+    {
+      _debugSerial->print("0x");
+      if ((publicKey64Bytes[i] >> 4) == 0) _debugSerial->print("0"); // print preceeding high nibble if it's zero
+      _debugSerial->print(publicKey64Bytes[i], HEX);
+      if (i != 63) _debugSerial->print(", ");
+      if ((63-i) % 16 == 0) _debugSerial->println();
+    }
+
+    _debugSerial->println("};");
+    _debugSerial->println();
+  }
+
+  return true;
+}
+
+boolean ATECCX08A::generatePublicKeyFromDevice(uint16_t slot)
+{
+  if (!sendCommand(COMMAND_OPCODE_GENKEY, GENKEY_MODE_PUBLIC, slot))
+    return false;
+
+  executionWait(EXECUTION_TIME_GENKEY); // time for IC to process command and exectute
+
+  // Now let's read back from the IC.
+  // public key (64), plus crc (2), plus count (1)
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + PUBLIC_KEY_SIZE + CRC_SIZE))
+    return false;
+
+  idleMode();
+
+  // update publicKey64Bytes[] array
+  if (!checkCount() || !checkCrc()) // check that it was a good message
+    return false;
+
+  // we don't need the count value (which is currently the first byte of the inputBuffer)
+  for (int i = 0 ; i < PUBLIC_KEY_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
+  {
+    publicKey64Bytes[i] = inputBuffer[RESPONSE_COUNT_SIZE + i];
+  }
+
+  // remember it, if the private key (and so the public key) of this slot can't change any more
+  if (publicKeyFixed(slot))
+  {
+    memcpy(_publicKeyCache, publicKey64Bytes, PUBLIC_KEY_SIZE);
+    _publicKeyCacheSlot = slot;
+  }
+
+  return true;
+}
+
+boolean ATECCX08A::publicKeyFixed(uint16_t slot)
+{
+  if (!_configZoneCached || slot >= DATA_ZONE_SLOTS)
+    return false; // config (or data) not locked yet, anything goes
+
+  uint16_t slotsLocked = configZone[CONFIG_ZONE_SLOTS_LOCK0] | (configZone[CONFIG_ZONE_SLOTS_LOCK1] << 8);
+  if ((slotsLocked & (1 << slot)) == 0)
+    return true; // bit clear = slot locked
+
+  return ((SlotConfig[slot] & (WRITE_CONFIG_GENKEY | WRITE_CONFIG_PRIVWRITE)) == 0);
+}
+
+/** \brief
+
+	read(uint8_t zone, uint16_t address, uint8_t length, boolean debug)
+
+    Reads data from the IC at a specific zone and address.
+	Your data response will be available at inputBuffer[].
+
+	For more info on address encoding, see datasheet pg 58.
+*/
+
+boolean ATECCX08A::read(uint8_t zone, uint16_t address, uint8_t length, boolean debug)
+{
+	return read_output(zone, address, length, NULL, debug);
+}
+
+boolean ATECCX08A::read_output(uint8_t zone, uint16_t address, uint8_t length, uint8_t * output, boolean debug)
+{
+  int i;
+  // adjust zone as needed for whether it's 4 or 32 bytes length read
+  // bit 7 of zone needs to be set correctly
+  // (0 = 4 Bytes are read)
+  // (1 = 32 Bytes are read)
+  if (length == 32)
+  {
+	zone |= 0b10000000; // set bit 7
+  }
+  else if (length == 4)
+  {
+	zone &= ~0b10000000; // clear bit 7
+  }
+  else
+  {
+	return false; // invalid length, abort.
+  }
+
+  if (!sendCommand(COMMAND_OPCODE_READ, zone, address))
+    return false;
+
+  executionWait(EXECUTION_TIME_READ); // time for IC to process command and exectute
+
+  // Now let's read back from the IC. ( + CRC_SIZE + count)
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + length + CRC_SIZE, debug))
+    return false;
+
+  idleMode();
+
+  if (!checkCount(debug) || !checkCrc(debug))
+    return false;
+
+  /* Copy data to output */
+  if (output)
+  {
+	  memcpy(output, inputBuffer + RESPONSE_READ_INDEX, length);
+  }
+
+  return true;
+}
+
+/** \brief
+
+	write(uint8_t zone, uint16_t address, uint8_t *data, uint8_t length_of_data)
+
+    Writes data to a specific zone and address on the IC.
+
+	For more info on zone and address encoding, see datasheet pg 58.
+*/
+
+boolean ATECCX08A::write(uint8_t zone, uint16_t address, uint8_t *data, uint8_t length_of_data)
+{
+  // adjust zone as needed for whether it's 4 or 32 bytes length write
+  // bit 7 of param1 needs to be set correctly
+  // (0 = 4 Bytes are written)
+  // (1 = 32 Bytes are written)
+  if (length_of_data == 32)
+  {
+	zone |= 0b10000000; // set bit 7
+  }
+  else if (length_of_data == 4)
+  {
+	zone &= ~0b10000000; // clear bit 7
+  }
+  else
+  {
+	return false; // invalid length, abort.
+  }
+
+  invalidateCache(); // config or key data may be changing
+
+  if (!sendCommand(COMMAND_OPCODE_WRITE, zone, address, data, length_of_data))
+    return false;
+
+  executionWait(EXECUTION_TIME_WRITE); // time for IC to process command and exectute
+
+  // Now let's read back from the IC and see if it reports back good things.
+  countGlobal = 0;
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
+    return false;
+
+  idleMode();
+
+  if (!checkCount() || !checkCrc())
+    return false;
+
+  // If we hear a "0x00", that means it had a successful write
+  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_WRITE)
+  {
+    return false;
+  }
+
+
+  return true;
+}
+
+/** \brief
+
+	createSignature(uint8_t *data, uint16_t slot)
+
+    Creates a 64-byte ECC signature on 32 bytes of data.
+	Defaults to use private key located in slot 0.
+	Your signature will be available at global variable signature[].
+
+	Note, the IC actually needs you to store your data in a temporary memory location
+	called TempKey. This function first loads TempKey, and then signs TempKey. Then it
+	receives the signature and copies it to signature[].
+*/
+
+boolean ATECCX08A::createSignature(uint8_t *data, uint16_t slot)
+{
+  boolean result;
+
+  if (!deadlineAllows(EXECUTION_TIME_NONCE + EXECUTION_TIME_SIGN))
+    return false; // don't waste a NONCE if the SIGN won't fit anyway
+
+  beginSession(); // load and sign in one wake
+
+  result = (loadTempKey(data) && signTempKey(slot));
+
+  endSession();
+
+  return result;
+}
+
+/** \brief
+
+	signWithSlots(uint8_t *data, uint16_t *slots, uint8_t count, uint8_t *signatures)
+
+	Creates a 64-byte ECC signature on the same 32 bytes of data with the private key in
+	each of the count slots listed in slots[] (e.g. {0, 1, 2} for multi-party authorization).
+	Signature n is copied to signatures[n * 64], so signatures must hold count * 64 bytes.
+
+	TempKey is loaded only once, and the SIGN commands are sent back-to-back in a single session.
+	If a SIGN fails (for example because TempKey was lost when the IC fell asleep),
+	TempKey is loaded again and that slot is retried once.
+*/
+
+boolean ATECCX08A::signWithSlots(uint8_t *data, uint16_t *slots, uint8_t count, uint8_t *signatures)
+{
+  boolean result;
+
+  beginSession();
+
+  result = loadTempKey(data);
+  uint16_t epoch = _tempKeyEpoch;
+
+  for (int i = 0; result && i < count; i++)
+  {
+    if (epoch != _tempKeyEpoch) // somebody else used TempKey at the last command boundary
+    {
+      result = loadTempKey(data);
+      epoch = _tempKeyEpoch;
+      if (!result)
+        break;
+    }
+
+    if (!signTempKey(slots[i]))
+    {
+      result = (loadTempKey(data) && signTempKey(slots[i]));
+      epoch = _tempKeyEpoch;
+      if (!result)
+        break;
+    }
+
+    memcpy(&signatures[i * SIGNATURE_SIZE], signature, SIGNATURE_SIZE);
+
+    if (i + 1 < count)
+      result = commandBoundary();
+  }
+
+  endSession();
+  _cancelRequested = false; // a late cancel() is forgotten, see cancel()
+
+  return result;
+}
+
+/** \brief
+
+	loadTempKey(uint8_t *data)
+
+	Writes 32 bytes of data to memory location "TempKey" on the IC.
+	Note, the data is provided externally by you, the user, and is included in the
+	command NONCE.
+
+    We will use the NONCE command in passthrough mode to load tempKey with our data (aka message).
+    Note, the datasheet warns that this does not provide protection agains replay attacks,
+    but we will protect again this because our server (Bob) is going to send us it's own unique random TOKEN,
+    when it requests data, and this will allow us to create a unique data + signature for every communication.
+*/
+
+boolean ATECCX08A::loadTempKey(uint8_t *data)
+{
+  if (!sendCommand(COMMAND_OPCODE_NONCE, NONCE_MODE_PASSTHROUGH, 0x0000, data, 32))
+    return false;
+
+  // note, param2 is 0x0000 (and param1 is PASSTHROUGH), so OutData will be just a single byte of zero upon completion.
+  // see ds pg 77 for more info
+
+  executionWait(EXECUTION_TIME_NONCE); // time for IC to process command and exectute
+
+  // Now let's read back from the IC.
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
+    return false; // responds with "0x00" if NONCE executed properly
+
+  idleMode();
+
+  if (!checkCount() || !checkCrc())
+    return false;
+
+  // If we hear a "0x00", that means it had a successful nonce
+  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_TEMPKEY)
+    return false;
+
+  tempKeyValid = true;
+
+  return true;
+}
+
+/** \brief
+
+	loadTempKeyRandom(uint8_t *numIn, boolean debug)
+
+	Uses the NONCE command in random mode: the IC generates a 32-byte random number (RandOut),
+	and sets TempKey to SHA-256(RandOut || numIn || 0x16 || mode || 0x00), in a single command.
+	numIn is 20 bytes of your own data (e.g. a counter or the other side's challenge).
+	RandOut is copied to random32Bytes[], so it can be sent off as a challenge, and the
+	other side can compute the same TempKey value to check a signature made with signTempKey().
+
+	This saves a whole command (and wake cycle) compared to updateRandom32Bytes() followed by loadTempKey().
+	The seed update follows the same policy as updateRandom32Bytes(), see setRandomSeedPolicy().
+*/
+
+boolean ATECCX08A::loadTempKeyRandom(uint8_t *numIn, boolean debug)
+{
+  uint8_t mode = randomMode(); // NONCE random modes share their values with the RANDOM command
+
+  if (!sendCommand(COMMAND_OPCODE_NONCE, mode, 0x0000, numIn, NONCE_NUMIN_SIZE))
+    return false;
+
+  executionWait(EXECUTION_TIME_NONCE); // time for IC to process command and exectute
+
+  // Now let's read back from the IC. This will be 35 bytes of data (count + 32_data_bytes + crc[0] + crc[1])
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_RANDOM_SIZE + CRC_SIZE, debug))
+    return false;
+
+  idleMode();
+
+  if (!checkCount(debug) || !checkCrc(debug))
+    return false;
+
+  if (mode == NONCE_MODE_SEED_UPDATE)
+    _randomSeedUpdated = true;
+
+  memcpy(random32Bytes, &inputBuffer[RESPONSE_COUNT_SIZE], RESPONSE_RANDOM_SIZE);
+
+  tempKeyValid = true;
+
+  return true;
+}
+
+/** \brief
+
+	signTempKey(uint16_t slot)
+
+	Create a 64 byte ECC signature for the contents of TempKey using the private key in Slot.
+	Default slot is 0
+
+	The response from this command (the signature) is stored in global varaible signature[].
+*/
+
+boolean ATECCX08A::signTempKey(uint16_t slot)
+{
+  if (!sendCommand(COMMAND_OPCODE_SIGN, SIGN_MODE_TEMPKEY, slot))
+    return false;
+
+  executionWait(EXECUTION_TIME_SIGN); // time for IC to process command and exectute
+
+  if (!receiveSignature())
+    return false;
+
+  // print signature[] to serial terminal nicely formatted for easy copy/pasting between sketches
+  _debugSerial->println();
+  _debugSerial->println("uint8_t signature[64] = {");
+  for (int i = 0; i < sizeof(signature) ; i++)
+  {
+    _debugSerial->print("0x");
+    if ((signature[i] >> 4) == 0) _debugSerial->print("0"); // print preceeding high nibble if it's zero
+    _debugSerial->print(signature[i], HEX);
+    if (i != 63) _debugSerial->print(", ");
+    if ((63-i) % 16 == 0) _debugSerial->println();
+  }
+  _debugSerial->println("};");
+
+	return true;
+}
+
+/** \brief
+
+	receiveSignature()
+
+	Reads the response to a SIGN command, and copies the 64 byte signature into global varaible signature[].
+*/
+
+boolean ATECCX08A::receiveSignature()
+{
+  // Now let's read back from the IC.
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + SIGNATURE_SIZE + CRC_SIZE)) // signature (64), plus crc (2), plus count (1)
+    return false;
+
+  idleMode();
+
+  // update signature[] array
+  if (!checkCount() || !checkCrc())  // check that it was a good message
+    return false;
+
+   // we don't need the count value (which is currently the first byte of the inputBuffer)
+  for (int i = 0 ; i < SIGNATURE_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
+  {
+    signature[i] = inputBuffer[RESPONSE_COUNT_SIZE + i];
+  }
+
+  return true;
+}
+
+/** \brief
+
+	createSignatureStart(uint8_t *data, uint16_t slot)
+
+	Same as createSignature(), but returns as soon as the SIGN command has been sent,
+	instead of sitting in delay() for the ~60ms the IC needs to compute the signature.
+	Use that time for other work (e.g. other connections), poll signatureReady(),
+	and then call createSignatureFinish() to collect the signature into signature[].
+
+	The IC (and the bus lock, if any) stays reserved until createSignatureFinish() is called,
+	so don't use any other library function in between. Finish within about a second,
+	or the watchdog will put the IC to sleep and the signature is lost.
+*/
+
+boolean ATECCX08A::createSignatureStart(uint8_t *data, uint16_t slot)
+{
+  if (_signaturePending)
+    return false; // only one at a time
+
+  if (!deadlineAllows(EXECUTION_TIME_NONCE + EXECUTION_TIME_SIGN))
+    return false;
+
+  beginSession(); // ended in createSignatureFinish()
+
+  if (!loadTempKey(data) || !sendCommand(COMMAND_OPCODE_SIGN, SIGN_MODE_TEMPKEY, slot))
+  {
+    endSession();
+    return false;
+  }
+
+  _signaturePending = true;
+  _signatureStart = millis();
+  _signatureTime = EXECUTION_TIME_SIGN; // time for IC to process command and exectute
+
+  return true;
+}
+
+/** \brief
+
+	signatureReady()
+
+	Returns true once the IC has had enough time to compute the signature started with
+	createSignatureStart(), so createSignatureFinish() will not have to wait.
+*/
+
+boolean ATECCX08A::signatureReady()
+{
+  return (!_signaturePending || (millis() - _signatureStart >= _signatureTime));
+}
+
+/** \brief
+
+	createSignatureFinish()
+
+	Collects the signature started with createSignatureStart() into signature[].
+	If it is called too early, it waits for whatever is left of the execution time.
+	Returns true if a good signature was received.
+*/
+
+boolean ATECCX08A::createSignatureFinish()
+{
+  if (!_signaturePending)
+    return false;
+
+  unsigned long elapsed = millis() - _signatureStart;
+  if (elapsed < _signatureTime)
+    executionWait(_signatureTime - elapsed);
+
+  _signaturePending = false;
+
+  boolean result = receiveSignature();
+
+  endSession();
+
+  return result;
+}
+
+/** \brief
+
+	verifySignature(uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+
+	Verifies a ECC signature using the message, signature and external public key.
+	Returns true if successful.
+
+	Note, it acutally uses loadTempKey, then uses the verify command in "external public key" mode.
+
+	If a verification cache has been set up with setVerifyCache(), a triple that already
+	verified successfully returns true straight from the cache, without talking to the IC.
+*/
+
+boolean ATECCX08A::verifySignature(uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+{
+  uint32_t tag = 0;
+
+  if (_verifyCacheCount)
+  {
+    tag = verifyCacheTag(message, signature, publicKey);
+
+    ATECCX08A_VerifyCacheEntry *entry = verifyCacheFind(tag, message, signature, publicKey);
+    if (entry)
+    {
+      entry->lastUsed = ++_verifyCacheClock;
+      verifyCacheHits++;
+      return true;
+    }
+
+    verifyCacheMisses++;
+  }
+
+  if (!deadlineAllows(EXECUTION_TIME_NONCE + EXECUTION_TIME_VERIFY))
+    return false;
+
+  beginSession(); // load and verify in one wake
+
+  // first, let's load the message into TempKey on the device, this uses NONCE command in passthrough mode.
+  boolean result = loadTempKey(message);
+  if (!result)
+    _debugSerial->println("Load TempKey Failure");
+  else
+    result = verifyTempKey(signature, publicKey);
+
+  endSession();
+
+  if (!result)
+    return false;
+
+  // only good signatures are remembered, a failure is always re-checked by the IC
+  if (_verifyCacheCount)
+    verifyCacheInsert(tag, message, signature, publicKey);
+
+  return true;
+}
+
+/** \brief
+
+	verifyTempKey(uint8_t *signature, uint8_t *publicKey)
+
+	Sends the verify command in "external public key" mode, for the message already in TempKey.
+	Returns true if the IC reports a good signature.
+*/
+
+boolean ATECCX08A::verifyTempKey(uint8_t *signature, uint8_t *publicKey)
+{
+  uint8_t data_sigAndPub[128];
+
+  // We can only send one *single* data array to sendCommand as Param2, so we need to combine signature and public key.
+  memcpy(&data_sigAndPub[0], &signature[0], SIGNATURE_SIZE);	// append signature
+  memcpy(&data_sigAndPub[SIGNATURE_SIZE], &publicKey[0], PUBLIC_KEY_SIZE);	// append external public key
+
+  if (!sendCommand(COMMAND_OPCODE_VERIFY, VERIFY_MODE_EXTERNAL, VERIFY_PARAM2_KEYTYPE_ECC, data_sigAndPub, sizeof(data_sigAndPub)))
+    return false;
+
+  executionWait(EXECUTION_TIME_VERIFY); // time for IC to process command and exectute
+
+  // Now let's read back from the IC.
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
+    return false;
+
+  idleMode();
+
+  if (!checkCount() || !checkCrc())
+    return false;
+
+  // If we hear a "0x00", that means it had a successful verify
+  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_VERIFY)
+    return false;
+
+  return true;
+}
+
+/** \brief
+
+	setVerifyCache(ATECCX08A_VerifyCacheEntry *entries, uint8_t count)
+
+	Gives verifySignature() an array of count entries to remember good verifications in.
+	Each entry is about 170 bytes, so the memory budget is entirely up to you (and your board).
+	When the cache is full, the least recently used entry is replaced.
+	Pass NULL (or count 0) to turn the cache off again.
+
+	Hit and miss totals are kept in verifyCacheHits and verifyCacheMisses,
+	so the hit rate is verifyCacheHits / (verifyCacheHits + verifyCacheMisses).
+*/
+
+void ATECCX08A::setVerifyCache(ATECCX08A_VerifyCacheEntry *entries, uint8_t count)
+{
+  _verifyCache = entries;
+  _verifyCacheCount = entries ? count : 0;
+  clearVerifyCache();
+}
+
+/** \brief
+
+	clearVerifyCache()
+
+	Forgets every remembered verification, and resets the hit/miss counters.
+*/
+
+void ATECCX08A::clearVerifyCache()
+{
+  for (int i = 0; i < _verifyCacheCount; i++)
+  {
+    _verifyCache[i].lastUsed = 0;
+  }
+
+  _verifyCacheClock = 0;
+  verifyCacheHits = 0;
+  verifyCacheMisses = 0;
+}
+
+/** \brief
+
+	verifyCacheTag(uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+
+	32-bit FNV-1a hash over the message (32), signature (64) and public key (64).
+	This is only used to skip entries quickly; a hit is always confirmed with a full compare.
+*/
+
+uint32_t ATECCX08A::verifyCacheTag(uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+{
+  uint32_t hash = 2166136261UL;
+
+  for (int i = 0; i < SHA256_SIZE; i++) hash = (hash ^ message[i]) * 16777619UL;
+  for (int i = 0; i < SIGNATURE_SIZE; i++) hash = (hash ^ signature[i]) * 16777619UL;
+  for (int i = 0; i < PUBLIC_KEY_SIZE; i++) hash = (hash ^ publicKey[i]) * 16777619UL;
+
+  return hash;
+}
+
+ATECCX08A_VerifyCacheEntry *ATECCX08A::verifyCacheFind(uint32_t tag, uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+{
+  for (int i = 0; i < _verifyCacheCount; i++)
+  {
+    ATECCX08A_VerifyCacheEntry *entry = &_verifyCache[i];
+
+    if (entry->lastUsed == 0 || entry->tag != tag)
+      continue;
+
+    if (memcmp(entry->message, message, SHA256_SIZE) == 0 &&
+        memcmp(entry->signature, signature, SIGNATURE_SIZE) == 0 &&
+        memcmp(entry->publicKey, publicKey, PUBLIC_KEY_SIZE) == 0)
+      return entry;
+  }
+
+  return NULL;
+}
+
+void ATECCX08A::verifyCacheInsert(uint32_t tag, uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+{
+  ATECCX08A_VerifyCacheEntry *victim = &_verifyCache[0];
+
+  // pick an empty entry, or else the least recently used one
+  for (int i = 1; i < _verifyCacheCount && victim->lastUsed; i++)
+  {
+    if (_verifyCache[i].lastUsed < victim->lastUsed)
+      victim = &_verifyCache[i];
+  }
+
+  victim->tag = tag;
+  victim->lastUsed = ++_verifyCacheClock;
+  memcpy(victim->message, message, SHA256_SIZE);
+  memcpy(victim->signature, signature, SIGNATURE_SIZE);
+  memcpy(victim->publicKey, publicKey, PUBLIC_KEY_SIZE);
+}
+
+/** \brief
+
+	ECDH(uint8_t *publicKey, uint16_t slot)
+
+	Computes an ECDH pre-master secret from the private key in slot (default slot 0),
+	and the other party's 64 byte public key (X and Y).
+	The 32 byte result is stored in global variable sharedSecret[].
+
+	Note, the slot's SlotConfig must allow ECDH, and must allow the result to be output in the clear.
+	If the slot is set up to write the result into slot+1 instead, this returns false, because
+	there is nothing for us to read back.
+*/
+
+boolean ATECCX08A::ECDH(uint8_t *publicKey, uint16_t slot)
+{
+  if (!sendCommand(COMMAND_OPCODE_ECDH, ECDH_MODE_SLOT, slot, publicKey, PUBLIC_KEY_SIZE))
+    return false;
+
+  executionWait(EXECUTION_TIME_ECDH); // time for IC to process command and exectute
+
+  // Now let's read back from the IC. shared secret (32), plus crc (2), plus count (1)
+  if (!receiveResponseData(RESPONSE_COUNT_SIZE + SHARED_SECRET_SIZE + CRC_SIZE))
+    return false;
+
+  idleMode();
+
+  // a status byte only (error, or secret written to slot+1), instead of the secret
+  if (inputBuffer[RESPONSE_COUNT_INDEX] != RESPONSE_COUNT_SIZE + SHARED_SECRET_SIZE + CRC_SIZE)
+    return false;
+
+  if (!checkCount() || !checkCrc())
+    return false;
+
+  memcpy(sharedSecret, &inputBuffer[RESPONSE_COUNT_SIZE], SHARED_SECRET_SIZE);
+
+  return true;
+}
+
+/** \brief
+
+	sha256(uint8_t * plain, size_t len, uint8_t * hash)
+
+	Creates a 32-byte SHA-256 digest of len bytes of data at plain, and copies it into hash.
+	This is a convenience wrapper around the streaming functions sha256Start(),
+	sha256Update() and sha256End(), for when the whole message is already in memory.
+
+	Other (more urgent) work can run between blocks, see setYieldCallback(). If that work
+	used TempKey, the running digest is gone, so the digest is started again from the beginning.
+	That happens at most once: the second run doesn't yield, so it always finishes.
+*/
+
+boolean ATECCX08A::sha256(uint8_t * plain, size_t len, uint8_t * hash)
+{
+	boolean result;
+	boolean restart;
+	boolean restarted = false;
+
+	beginSession(); // all the SHA commands in one wake
+
+	do
+	{
+		restart = false;
+		result = sha256Start();
+
+		uint16_t epoch = _tempKeyEpoch;
+
+		for (size_t offset = 0; result && offset < len; offset += SHA_BLOCK_SIZE)
+		{
+			size_t chunk = (len - offset < SHA_BLOCK_SIZE) ? (len - offset) : SHA_BLOCK_SIZE;
+
+			result = sha256Update(plain + offset, chunk);
+
+			if (result && offset + chunk < len)
+			{
+				result = restarted ? !cancelled() : commandBoundary(); // after a restart, finish without yielding
+
+				if (result && epoch != _tempKeyEpoch)
+				{
+					restart = true;
+					restarted = true;
+					break;
+				}
+			}
+		}
+	} while (restart);
+
+	result = (result && sha256End(hash));
+
+	endSession();
+	_cancelRequested = false; // a late cancel() is forgotten, see cancel()
+
+	return result;
+}
+
+/** \brief
+
+	sha256Start()
+
+	Starts a new streaming SHA-256 digest on the IC (SHA command, start mode).
+	Follow with any number of sha256Update() calls, then sha256End().
+	Note, the IC keeps the running digest in TempKey, so don't use TempKey (sign, verify, nonce)
+	until you have called sha256End(). If other processes share the IC (see setBusLock()),
+	wrap the whole digest in beginSession()/endSession() so nobody else can use TempKey in between.
+*/
+
+boolean ATECCX08A::sha256Start()
+{
+	_shaBlockLength = 0;
+
+	if (!_sessionDepth)
+		_cancelRequested = false; // a new digest, forget any old cancel()
+
+	return shaCommand(SHA_START, NULL, 0);
+}
+
+/** \brief
+
+	sha256Update(uint8_t * data, size_t len)
+
+	Adds len bytes of data to the digest started with sha256Start().
+	The IC only accepts whole 64-byte blocks in update mode, so any remainder is held
+	in _shaBlock[] until more data arrives, or until sha256End() sends it.
+	This lets you hash messages that are much larger than RAM (e.g. a log file read in pieces).
+*/
+
+boolean ATECCX08A::sha256Update(uint8_t * data, size_t len)
+{
+	while (len)
+	{
+		size_t copy = SHA_BLOCK_SIZE - _shaBlockLength;
+		if (copy > len) copy = len;
+
+		memcpy(&_shaBlock[_shaBlockLength], data, copy);
+		_shaBlockLength += copy;
+		data += copy;
+		len -= copy;
+
+		if (_shaBlockLength == SHA_BLOCK_SIZE)
+		{
+			// END command can only accept up to 63 bytes, so a full block always goes out as an UPDATE
+			if (!shaCommand(SHA_UPDATE, _shaBlock, SHA_BLOCK_SIZE))
+				return false;
+
+			_shaBlockLength = 0;
+
+			if (_cancelRequested && len)
+				return !cancelled(); // cancelled, see cancel(). No yield here, see setYieldCallback()
+		}
+	}
+
+	return true;
+}
+
+/** \brief
+
+	sha256End(uint8_t * hash)
+
+	Sends whatever is left in _shaBlock[] (0-63 bytes) with the SHA end command,
+	and copies the resulting 32-byte digest into hash.
+*/
+
+boolean ATECCX08A::sha256End(uint8_t * hash)
+{
+	int i;
+
+	_cancelRequested = false; // the last command can't be cancelled, so forget any cancel() now
+
+	if (!sendCommand(COMMAND_OPCODE_SHA, SHA_END, _shaBlockLength, _shaBlock, _shaBlockLength))
+		return false;
+
+	_shaBlockLength = 0;
+
+	/* Read digest */
+	executionWait(EXECUTION_TIME_SHA);
+
+	if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SHA_SIZE + CRC_SIZE))
+		return false;
+
+	idleMode();
+
+	if (!checkCount() || !checkCrc())
+		return false;
+
+	/* Copy digest */
+	for (i = 0; i < SHA256_SIZE; ++i)
+	{
+		hash[i] = inputBuffer[RESPONSE_SHA_INDEX + i];
+	}
+
+	return true;
+}
+
+/** \brief
+
+	sha256Chain(uint8_t * previousHash, uint8_t * data, size_t len, uint8_t * hash)
+
+	Creates the next link of a hash chain: hash = SHA-256(previousHash || data).
+	previousHash is the 32-byte digest of the prior entry (use all zeros for the first entry).
+	Changing, removing or reordering any entry changes every hash after it, so signing only the
+	latest hash every so often (see createSignature()) protects the whole log up to that point.
+	hash may point to the same array as previousHash.
+*/
+
+boolean ATECCX08A::sha256Chain(uint8_t * previousHash, uint8_t * data, size_t len, uint8_t * hash)
+{
+	boolean result;
+
+	beginSession();
+
+	result = (sha256Start() && sha256Update(previousHash, SHA256_SIZE) && sha256Update(data, len) && sha256End(hash));
+
+	endSession();
+
+	return result;
+}
+
+/** \brief
+
+	shaCommand(uint8_t mode, uint8_t * data, uint8_t length)
+
+	Sends a single SHA command that only answers with a status byte (start or update),
+	and listens for success response (0x00).
+*/
+
+boolean ATECCX08A::shaCommand(uint8_t mode, uint8_t * data, uint8_t length)
+{
+	if (!sendCommand(COMMAND_OPCODE_SHA, mode, length, data, length))
+		return false;
+
+	executionWait(EXECUTION_TIME_SHA); // time for IC to process command and exectute
+
+	if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
+		return false;
+
+	idleMode();
+
+	if (!checkCount() || !checkCrc())
+		return false;
+
+	// If we hear a "0x00", that means it had a successful load
+	if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_SHA)
+		return false;
+
+	return true;
+}
+
+/** \brief
+
+	setI2CAddress(uint8_t newAddress)
+
+	Changes the I2C address of the IC (byte 16 of the config zone), so that several of them
+	can share one bus. This only works before lockConfig(), after which the address is fixed for good.
+	The IC reads its address when it wakes from sleep, so we put it to sleep, point this instance
+	at the new address, and check that it answers there (with getInfo()).
+
+	To bring up several identical ICs (all at ATECC508A_ADDRESS_DEFAULT out of the box),
+	enable them one at a time (power/enable lines, or an I2C mux), and move each one out of
+	the way before enabling the next. See Example9_MultiChip.
+
+	Returns false if the config zone is already locked, or if the write failed (the IC stays
+	at the old address). It can't be used inside a session either, because the IC has to go
+	to sleep (lastStatus is ATECC_STATUS_IN_SESSION then).
+	Once the new address is written, this instance moves to it for good, even if the IC
+	doesn't answer there right away (returns false, and lastStatus says why).
+*/
+
+boolean ATECCX08A::setI2CAddress(uint8_t newAddress)
+{
+  uint8_t data[4];
+
+  if (newAddress < DISCOVER_FIRST_ADDRESS || newAddress > DISCOVER_LAST_ADDRESS)
+    return false; // reserved I2C addresses
+
+  if (_sessionDepth)
+  {
+    lastStatus = ATECC_STATUS_IN_SESSION; // sleepMode() wouldn't do anything
+    return false;
+  }
+
+  // bytes 84-87, check that the config zone is still unlocked (0x55)
+  if (!read_output(ZONE_CONFIG, (CONFIG_ZONE_LOCK_STATUS / 4), 4, data))
+    return false;
+
+  if (data[CONFIG_ZONE_LOCK_STATUS % 4] != 0x55)
+    return false;
+
+  // bytes 16-19, keep the other three (reserved, OTP mode, chip mode) as they are
+  if (!read_output(ZONE_CONFIG, (CONFIG_ZONE_I2C_ADDRESS / 4), 4, data))
+    return false;
+
+  data[CONFIG_ZONE_I2C_ADDRESS % 4] = newAddress << 1; // stored shifted, bit 0 must stay 0 (I2C, not single wire)
+
+  if (!write(ZONE_CONFIG, (CONFIG_ZONE_I2C_ADDRESS / 4), data, 4))
+    return false;
+
+  // put it to sleep, so it comes back up at the new address
+  if (!acquireBus())
+    return false;
+
+  wakeUp();
+  sleepMode();
+
+  // the new address is in EEPROM now, the old one won't answer again
+  _i2caddr = newAddress;
+  configZone[CONFIG_ZONE_I2C_ADDRESS] = data[CONFIG_ZONE_I2C_ADDRESS % 4];
+
+  if (!getInfo())
+  {
+    if (lastStatus == ATECC_STATUS_OK) lastStatus = ATECC_STATUS_COMM_ERROR;
+    return false;
+  }
+
+  return true;
+}
+
+/** \brief
+
+	writeConfigSparkFun()
+
+	Writes the necessary configuration settings to the IC in order to work with the SparkFun Arduino Library examples.
+	For key slots 0 and 1, this enables ECC private key pairs,public key generation, and external signature verifications.
+
+	Returns true if write commands were successful.
+*/
+
+boolean ATECCX08A::writeConfigSparkFun()
+{
+  // keep track of our write command results.
+  boolean result1;
+  boolean result2;
+
+  // set keytype on slot 0 and 1 to 0x3300
+  // Lockable, ECC, PuInfo set (public key always allowed to be generated), contains a private Key
+  uint8_t data1[] = {0x33, 0x00, 0x33, 0x00}; // 0x3300 sets the keyconfig.keyType, see datasheet pg 20
+  result1 = write(ZONE_CONFIG, (96 / 4), data1, 4);
+  // set slot config on slot 0 and 1 to 0x8320
+  // EXT signatures, INT signatures, IsSecret, Write config never
+  uint8_t data2[] = {0x83, 0x20, 0x83, 0x20}; // for slot config bit definitions see datasheet pg 20
+  result2 = write(ZONE_CONFIG, (20 / 4), data2, 4);
+
+  return (result1 && result2);
+}
+
+/** \brief
+
+	sendCommand(uint8_t command_opcode, uint8_t param1, uint16_t param2, uint8_t *data, size_t length_of_data)
+
+	Generic function for sending commands to the IC.
+
+	This function handles creating the "total transmission" to the IC.
+	This contains WORD_ADDRESS_VALUE, COUNT, OPCODE, PARAM1, PARAM2, DATA (optional), and CRCs.
+
+	Note, it always calls the "wake()" function, assuming that you have let the IC fall asleep (default 1.7 sec),
+	unless a session is open (see beginSession()) and the IC is still awake from an earlier command.
+
+	Note, for anything other than a command (reset, sleep and idle), you need a different "Word Address Value",
+	So those specific transmissions are handled in unique functions.
+*/
+
+boolean ATECCX08A::sendCommand(uint8_t command_opcode, uint8_t param1, uint16_t param2, uint8_t *data, size_t length_of_data)
+{
+  // build packet array (total_transmission) to send a communication to IC, with opcode COMMAND
+  // It expects to see: word address, count, command opcode, param1, param2, data (optional), CRC[0], CRC[1]
+  uint8_t transmission_without_crc_length;
+  uint8_t total_transmission_length;
+  uint8_t total_transmission[UINT8_MAX];
+  uint8_t packet_to_CRC[UINT8_MAX]; // minus word address (1) and crc (2).
+
+  /* Validate no integer overflow */
+  if (length_of_data > UINT8_MAX - ATRCC508A_PROTOCOL_OVERHEAD)
+    return false;
+
+  lastStatus = ATECC_STATUS_OK;
+
+  /* Don't start a command that can't finish before the deadline */
+  if (!deadlineAllows(executionTime(command_opcode)))
+    return false;
+
+  /* Or one that is over the duty-cycle budget (this may wait, see setDutyBudget()) */
+  if (!dutyAllows(command_opcode))
+    return false;
+
+  total_transmission_length = length_of_data + ATRCC508A_PROTOCOL_OVERHEAD;
+
+  total_transmission[ATRCC508A_PROTOCOL_FIELD_COMMAND] = WORD_ADDRESS_VALUE_COMMAND;      // word address value (type command)
+  total_transmission[ATRCC508A_PROTOCOL_FIELD_LENGTH] = total_transmission_length - ATRCC508A_PROTOCOL_FIELD_SIZE_LENGTH;    // count, does not include itself, so "-1"
+  total_transmission[ATRCC508A_PROTOCOL_FIELD_OPCODE] = command_opcode;                   // command
+  total_transmission[ATRCC508A_PROTOCOL_FIELD_PARAM1] = param1;                           // param1
+  memcpy(&total_transmission[ATRCC508A_PROTOCOL_FIELD_PARAM2], &param2, sizeof(param2));  // append param2
+  memcpy(&total_transmission[ATRCC508A_PROTOCOL_FIELD_DATA], &data[0], length_of_data);   // append data
+
+  // update CRCs
+  transmission_without_crc_length = total_transmission_length - (ATRCC508A_PROTOCOL_FIELD_SIZE_COMMAND + ATRCC508A_PROTOCOL_FIELD_SIZE_CRC); // copy over just what we need to CRC starting at index 1
+
+  memcpy(packet_to_CRC, &total_transmission[ATRCC508A_PROTOCOL_FIELD_LENGTH], transmission_without_crc_length);
+
+  //  _debugSerial->println("packet_to_CRC: ");
+  //  for (int i = 0; i < sizeof(packet_to_CRC) ; i++)
+  //  {
+  //  _debugSerial->print(packet_to_CRC[i], HEX);
+  //  _debugSerial->print(",");
+  //  }
+  //  _debugSerial->println();
+
+  atca_calculate_crc(transmission_without_crc_length, packet_to_CRC); // count includes crc[0] and crc[1], so we must subtract 2 before creating crc
+  //_debugSerial->println(crc[0], HEX);
+  //_debugSerial->println(crc[1], HEX);
+
+  memcpy(&total_transmission[total_transmission_length - ATRCC508A_PROTOCOL_FIELD_SIZE_CRC], crc, ATRCC508A_PROTOCOL_FIELD_SIZE_CRC);  // append crcs
+
+  if (!acquireBus()) // released again by idleMode() (or endSession())
+    return false;
+
+  if (_sessionDepth && _awake && (millis() - _wakeTime > ATRCC508A_SESSION_REWAKE_MS))
+    enterIdle(); // idle keeps TempKey, and the wake below restarts the watchdog
+
+  _traceOpcode = command_opcode;
+  _traceParam2 = param2;
+  _commandStart = micros();
+
+  if (!_sessionDepth && !_traceCommandSpan)
+  {
+    _traceCommandSpan = true; // a single command outside a session is an operation of its own, until idleMode()
+    trace(TRACE_PHASE_SESSION, true);
   }
 
-  if (debug)
+  if (command_opcode == COMMAND_OPCODE_NONCE || (command_opcode == COMMAND_OPCODE_SHA && param1 == SHA_START))
   {
-    _debugSerial->print("inputBuffer: ");
-    for (int i = 0; i < countGlobal ; i++)
-    {
-      _debugSerial->print(inputBuffer[i], HEX);
-      _debugSerial->print(",");
-    }
-    _debugSerial->println();
+    _tempKeyEpoch++; // TempKey is about to be replaced
+    tempKeyValid = false; // until a NONCE succeeds
   }
 
-  return true;
-}
+  if (!_sessionDepth || !_awake)
+    wakeUp();
 
-/** \brief
+  #ifdef ATECCX08A_FAULT_INJECTION
+  if (_faultSleep)
+  {
+    _faultSleep = false; // injected, see setFaultInjection(). We still think it's awake, just like after a real watchdog timeout
+    _i2cPort->beginTransmission(_i2caddr);
+    _i2cPort->write(WORD_ADDRESS_VALUE_SLEEP);
+    _i2cPort->endTransmission();
+  }
+  #endif
 
-	checkCount(boolean debug)
+  trace(TRACE_PHASE_WRITE, true);
 
-	This function checks that the count byte received in the most recent message equals countGlobal
-	Call receiveResponseData, and then imeeditately call this to check the count of the complete message.
-	Returns true if inputBuffer[0] == countGlobal.
-*/
+  _i2cPort->beginTransmission(_i2caddr);
+  _i2cPort->write(total_transmission, total_transmission_length);
 
-boolean ATECCX08A::checkCount(boolean debug)
-{
-  if (debug)
+  if (_i2cPort->endTransmission() != 0 && _sdaPin != BUS_RECOVERY_NO_PIN && !_recovering && recoverBus())
   {
-    _debugSerial->print("countGlobal: 0x");
-	_debugSerial->println(countGlobal, HEX);
-	_debugSerial->print("count heard from IC (inpuBuffer[0]): 0x");
-    _debugSerial->println(inputBuffer[0], HEX);
+    // the bus was stuck, send it again now that it's clear (anything in TempKey is gone though)
+    _i2cPort->beginTransmission(_i2caddr);
+    _i2cPort->write(total_transmission, total_transmission_length);
+    _i2cPort->endTransmission();
   }
 
-  // Check count; the first byte sent from IC is count, and it should be equal to the actual message count
-  if (inputBuffer[RESPONSE_COUNT_INDEX] != countGlobal)
-  {
-	if (debug) _debugSerial->println("Message Count Error");
-	  return false;
-  }
+  trace(TRACE_PHASE_WRITE, false);
+
+  _commandTiming = true; // armed after the wake, so the wake response doesn't count as the command's response
 
   return true;
 }
 
 /** \brief
 
-	checkCrc(boolean debug)
+	setYieldCallback(void (*callback)(void *context), void *context)
 
-	This function checks that the CRC bytes received in the most recent message equals a calculated CRCs
-	Call receiveResponseData, then call immediately call this to check the CRCs of the complete message.
+	Long sequences of commands (sha256() of a big buffer, readConfigZone(), refillRandomPool(),
+	signWithSlots()) call callback between their commands. From there you can run more urgent
+	library operations (e.g. sign a handshake) right away, instead of waiting for the whole
+	sequence to finish. Background work then only holds up urgent work for a single command.
+
+	If the urgent work replaced TempKey, the sequence notices: signWithSlots() loads TempKey again,
+	and sha256() starts its digest over (the IC can't save a SHA context on the side).
+	The streaming sha256Update() doesn't yield, as it can't replay data it no longer has.
+	The callback is not called again while it is running.
+	Pass NULL to turn it off (the default).
 */
 
-boolean ATECCX08A::checkCrc(boolean debug)
+void ATECCX08A::setYieldCallback(void (*callback)(void *context), void *context)
 {
-  // Check CRC[0] and CRC[1] are good to go.
-  atca_calculate_crc(countGlobal - CRC_SIZE, inputBuffer);   // first calculate it
-
-  if (debug)
-  {
-    _debugSerial->print("CRC[0] Calc: 0x");
-	_debugSerial->println(crc[0], HEX);
-	_debugSerial->print("CRC[1] Calc: 0x");
-    _debugSerial->println(crc[1], HEX);
-  }
-
-  if ( (inputBuffer[countGlobal - (CRC_SIZE - 1)] != crc[1]) || (inputBuffer[countGlobal - CRC_SIZE] != crc[0]) )   // then check the CRCs.
-  {
-	if (debug) _debugSerial->println("Message CRC Error");
-	  return false;
-  }
-
-  return true;
+  _yieldCallback = callback;
+  _yieldContext = context;
 }
 
 /** \brief
 
-	atca_calculate_crc(uint8_t length, uint8_t *data)
+	commandBoundary()
 
-    This function calculates CRC.
-    It was copied directly from the App Note provided from Microchip.
-    Note, it seems to be their own unique type of CRC cacluation.
-    View the entire app note here:
-    http://ww1.microchip.com/downloads/en/AppNotes/Atmel-8936-CryptoAuth-Data-Zone-CRC-Calculation-ApplicationNote.pdf
-    \param[in] length number of bytes in buffer
-    \param[in] data pointer to data for which CRC should be calculated
+	Called between the commands of a long sequence. Runs the yield callback, if any.
+	Returns false if the sequence should stop.
 */
 
-void ATECCX08A::atca_calculate_crc(uint8_t length, uint8_t *data)
+boolean ATECCX08A::commandBoundary()
 {
-  uint8_t counter;
-  uint16_t crc_register = 0;
-  uint16_t polynom = 0x8005;
-  uint8_t shift_register;
-  uint8_t data_bit, crc_bit;
-  for (counter = 0; counter < length; counter++) {
-    for (shift_register = 0x01; shift_register > 0x00; shift_register <<= 1) {
-      data_bit = (data[counter] & shift_register) ? 1 : 0;
-      crc_bit = crc_register >> 15;
-      crc_register <<= 1;
-      if (data_bit != crc_bit)
-        crc_register ^= polynom;
-    }
+  if (_yieldCallback && !_yielding)
+  {
+    _yielding = true;
+    _yieldCallback(_yieldContext);
+    _yielding = false;
   }
-  crc[0] = (uint8_t) (crc_register & 0x00FF);
-  crc[1] = (uint8_t) (crc_register >> 8);
-}
 
+  return !cancelled();
+}
 
 /** \brief
 
-	cleanInputBuffer()
+	cancelled()
 
-    This function sets the entire inputBuffer to 0xFFs.
-	It is helpful for debugging message/count/CRCs errors.
+	Returns true if cancel() was called, after putting things in a known state for the caller to stop.
 */
 
-void ATECCX08A::cleanInputBuffer()
+boolean ATECCX08A::cancelled()
 {
-  for (int i = 0; i < sizeof(inputBuffer) ; i++)
+  if (_cancelRequested)
   {
-    inputBuffer[i] = 0xFF;
+    // leave everything in a known state: TempKey can't be trusted, and the session end will idle the IC
+    _cancelRequested = false;
+    tempKeyValid = false;
+    _tempKeyEpoch++;
+    _shaBlockLength = 0;
+    lastStatus = ATECC_STATUS_CANCELLED;
+    return true;
   }
+
+  return false;
 }
 
 /** \brief
 
-	createNewKeyPair(uint16_t slot)
+	cancel()
 
-    This function sends the command to create a new key pair (private AND public)
-	in the slot designated by argument slot (default slot 0).
-	Sparkfun Default Configuration Sketch calls this, and then locks the data/otp zones and slot 0.
+	Asks the operation in progress to stop at the next command boundary, e.g. a long sha256()
+	or sha256Update(), readConfigZone(), refillRandomPool() or signWithSlots(). It is safe to call
+	from an interrupt, or from the yield callback (see setYieldCallback()).
+	The cancelled function returns false with lastStatus set to ATECC_STATUS_CANCELLED, the IC is put
+	into idle mode, and tempKeyValid is cleared, so the next operation can start straight away.
+	A command that has already been sent always runs to completion (the IC can't be interrupted).
+	A cancel() that comes too late (no multi-command operation in progress, or only its last command left)
+	is forgotten when that operation finishes, or when the next one starts.
 */
 
-boolean ATECCX08A::createNewKeyPair(uint16_t slot)
+void ATECCX08A::cancel()
 {
-  if (!sendCommand(COMMAND_OPCODE_GENKEY, GENKEY_MODE_NEW_PRIVATE, slot))
-    return false;
-
-  delay(115); // time for IC to process command and exectute
-
-  // Now let's read back from the IC.
+  _cancelRequested = true;
+}
 
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + PUBLIC_KEY_SIZE + CRC_SIZE)) // public key (64), plus crc (2), plus count (1)
-    return false;
+/** \brief
 
-  idleMode();
+	setDeadline(unsigned long deadline)
 
-  // update publicKey64Bytes[] array
-  if (!checkCount() || !checkCrc()) // check that it was a good message
-    return false;
+	Sets a deadline (in millis() time) for everything the library does from now on, until clearDeadline().
+	A command is not even started if its execution time (see executionTime()) would run past the deadline,
+	and response retries stop once the deadline has passed. Either way, the function returns false
+	and lastStatus is set to ATECC_STATUS_TIMEOUT, so you can tell it apart from a failed command.
 
-  // we don't need the count value (which is currently the first byte of the inputBuffer)
-  for (int i = 0 ; i < PUBLIC_KEY_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
-  {
-    publicKey64Bytes[i] = inputBuffer[i + RESPONSE_COUNT_SIZE];
-  }
+	e.g. setDeadline(millis() + 40); createSignature(data); will refuse to start the 60ms SIGN.
+*/
 
-  return true;
+void ATECCX08A::setDeadline(unsigned long deadline)
+{
+  _deadline = deadline;
+  _deadlineSet = true;
 }
 
 /** \brief
 
-	generatePublicKey(uint16_t slot, boolean debug)
+	clearDeadline()
 
-    This function uses the GENKEY command in "Public Key Computation" mode.
+	Removes the deadline set with setDeadline().
+*/
 
-    Generates an ECC public key based upon the private key stored in the slot defined by the KeyID
-	parameter (aka slot). Defaults to slot 0.
+void ATECCX08A::clearDeadline()
+{
+  _deadlineSet = false;
+}
 
-	Note, if you haven't created a private key in the slot already, then this will fail.
+/** \brief
 
-	The generated public key is read back from the device, and then copied from inputBuffer to
-	a global variable named publicKey64Bytes for later use.
+	deadlineAllows(unsigned long ms)
+
+	Returns true if there is no deadline, or if ms more milliseconds of work still fit before it.
+	Otherwise sets lastStatus to ATECC_STATUS_TIMEOUT and returns false.
 */
 
-boolean ATECCX08A::generatePublicKey(uint16_t slot, boolean debug)
+boolean ATECCX08A::deadlineAllows(unsigned long ms)
 {
-  if (!sendCommand(COMMAND_OPCODE_GENKEY, GENKEY_MODE_PUBLIC, slot))
-    return false;
+  if (!_deadlineSet || (long)(_deadline - millis()) >= (long)ms)
+    return true;
 
-  delay(115); // time for IC to process command and exectute
+  lastStatus = ATECC_STATUS_TIMEOUT;
+  return false;
+}
 
-  // Now let's read back from the IC.
-  // public key (64), plus crc (2), plus count (1)
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + PUBLIC_KEY_SIZE + CRC_SIZE))
-    return false;
+/** \brief
 
-  idleMode();
+	executionTime(uint8_t opcode)
 
-  // update publicKey64Bytes[] array
-  if (!checkCount() || !checkCrc()) // check that it was a good message
-    return false;
+	Returns the maximum execution time (ms) of a command, from the EXECUTION_TIME_ table.
+*/
 
-  // we don't need the count value (which is currently the first byte of the inputBuffer)
-  for (int i = 0 ; i < PUBLIC_KEY_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
+uint8_t ATECCX08A::executionTime(uint8_t opcode)
+{
+  switch (opcode)
   {
-    publicKey64Bytes[i] = inputBuffer[RESPONSE_COUNT_SIZE + i];
+    case COMMAND_OPCODE_INFO: return EXECUTION_TIME_INFO;
+    case COMMAND_OPCODE_LOCK: return EXECUTION_TIME_LOCK;
+    case COMMAND_OPCODE_RANDOM: return EXECUTION_TIME_RANDOM;
+    case COMMAND_OPCODE_READ: return EXECUTION_TIME_READ;
+    case COMMAND_OPCODE_WRITE: return EXECUTION_TIME_WRITE;
+    case COMMAND_OPCODE_SHA: return EXECUTION_TIME_SHA;
+    case COMMAND_OPCODE_GENKEY: return EXECUTION_TIME_GENKEY;
+    case COMMAND_OPCODE_NONCE: return EXECUTION_TIME_NONCE;
+    case COMMAND_OPCODE_SIGN: return EXECUTION_TIME_SIGN;
+    case COMMAND_OPCODE_VERIFY: return EXECUTION_TIME_VERIFY;
+    case COMMAND_OPCODE_ECDH: return EXECUTION_TIME_ECDH;
+    default: return EXECUTION_TIME_GENKEY; // unknown, assume the longest
   }
+}
 
-  if (debug)
-  {
-    _debugSerial->println("This device's Public Key:");
-    _debugSerial->println();
-    _debugSerial->println("uint8_t publicKey[64] = {");
-    for (int i = 0; i < sizeof(publicKey64Bytes) ; i++)
-    {
-      _debugSerial->print("0x");
-      if ((publicKey64Bytes[i] >> 4) == 0) _debugSerial->print("0"); // print preceeding high nibble if it's zero
-      _debugSerial->print(publicKey64Bytes[i], HEX);
-      if (i != 63) _debugSerial->print(", ");
-      if ((63-i) % 16 == 0) _debugSerial->println();
-    }
+/** \brief
 
-    _debugSerial->println("};");
-    _debugSerial->println();
-  }
+	executionWait(unsigned long ms)
 
-  return true;
+	Waits for the IC to execute the command we just sent (see the EXECUTION_TIME_ table).
+*/
+
+void ATECCX08A::executionWait(unsigned long ms)
+{
+  trace(TRACE_PHASE_EXECUTE, true);
+
+  delay(ms);
+
+  trace(TRACE_PHASE_EXECUTE, false);
 }
 
+#ifdef ATECCX08A_FAULT_INJECTION
 /** \brief
 
-	read(uint8_t zone, uint16_t address, uint8_t length, boolean debug)
+	setFaultInjection(ATECCX08A_Fault *faults, uint8_t faultCount, uint32_t seed)
 
-    Reads data from the IC at a specific zone and address.
-	Your data response will be available at inputBuffer[].
+	Makes things go wrong on purpose, so you can see how your code (and the library's retries,
+	bus recovery and deadlines) copes, e.g. while recording latency histograms on Linux against
+	a software model of the IC, or on real hardware.
+	Each fault fires either by probability (per response read, from a simple LCG seeded with seed,
+	so runs are repeatable), or on a schedule: on response number "at", and then every "every"
+	responses after it. Wake responses count too.
 
-	For more info on address encoding, see datasheet pg 58.
+	NACK, CRC, TRUNCATE and EXEC_ERROR hit the response being read. WATCHDOG puts the IC to sleep
+	right before the next command is written, and BUS_HANG makes the next "count" wakes fail
+	(as if SDA was stuck), which is what bus recovery looks for.
+	Each fault's "fired" counts how many times it was injected. Pass NULL to stop.
+
+	Only there when the library is built with ATECCX08A_FAULT_INJECTION defined.
 */
 
-boolean ATECCX08A::read(uint8_t zone, uint16_t address, uint8_t length, boolean debug)
+void ATECCX08A::setFaultInjection(ATECCX08A_Fault *faults, uint8_t faultCount, uint32_t seed)
 {
-	return read_output(zone, address, length, NULL, debug);
+  _faults = faults;
+  _faultCount = faults ? faultCount : 0;
+  _faultRandom = seed;
+  _faultResponse = 0;
+  _faultNackPolls = 0;
+  _faultHangWakes = 0;
+  _faultSleep = false;
+  _faultCorrupt = 0;
+
+  for (uint8_t i = 0; i < _faultCount; i++)
+    faults[i].fired = 0;
 }
 
-boolean ATECCX08A::read_output(uint8_t zone, uint16_t address, uint8_t length, uint8_t * output, boolean debug)
+void ATECCX08A::injectFaults()
 {
-  int i;
-  // adjust zone as needed for whether it's 4 or 32 bytes length read
-  // bit 7 of zone needs to be set correctly
-  // (0 = 4 Bytes are read)
-  // (1 = 32 Bytes are read)
-  if (length == 32)
-  {
-	zone |= 0b10000000; // set bit 7
-  }
-  else if (length == 4)
-  {
-	zone &= ~0b10000000; // clear bit 7
-  }
-  else
-  {
-	return false; // invalid length, abort.
-  }
-
-  if (!sendCommand(COMMAND_OPCODE_READ, zone, address))
-    return false;
+  _faultResponse++;
+  _faultCorrupt = 0;
 
-  delay(1); // time for IC to process command and exectute
+  for (uint8_t i = 0; i < _faultCount; i++)
+  {
+    ATECCX08A_Fault &fault = _faults[i];
+    boolean fire;
 
-  // Now let's read back from the IC. ( + CRC_SIZE + count)
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + length + CRC_SIZE, debug))
-    return false;
+    if (fault.probability)
+    {
+      _faultRandom = _faultRandom * 1103515245UL + 12345UL;
+      fire = ((_faultRandom >> 16) & 0xFFFF) < fault.probability;
+    }
+    else
+    {
+      fire = fault.at && _faultResponse >= fault.at
+             && (_faultResponse == fault.at || (fault.every && (_faultResponse - fault.at) % fault.every == 0));
+    }
 
-  idleMode();
+    if (!fire)
+      continue;
 
-  if (!checkCount(debug) || !checkCrc(debug))
-    return false;
+    fault.fired++;
 
-  /* Copy data to output */
-  if (output)
-  {
-	  memcpy(output, inputBuffer + RESPONSE_READ_INDEX, length);
+    switch (fault.type)
+    {
+      case FAULT_NACK: _faultNackPolls = fault.count; break;
+      case FAULT_WATCHDOG: _faultSleep = true; break;
+      case FAULT_BUS_HANG: _faultHangWakes = fault.count; break;
+      case FAULT_TRUNCATE: _faultTruncate = fault.count; _faultCorrupt |= (1 << FAULT_TRUNCATE); break;
+      default: _faultCorrupt |= (1 << fault.type); break; // CRC, EXEC_ERROR
+    }
   }
-
-  return true;
 }
 
-/** \brief
-
-	write(uint8_t zone, uint16_t address, uint8_t *data, uint8_t length_of_data)
-
-    Writes data to a specific zone and address on the IC.
-
-	For more info on zone and address encoding, see datasheet pg 58.
-*/
-
-boolean ATECCX08A::write(uint8_t zone, uint16_t address, uint8_t *data, uint8_t length_of_data)
+void ATECCX08A::corruptResponse()
 {
-  // adjust zone as needed for whether it's 4 or 32 bytes length write
-  // bit 7 of param1 needs to be set correctly
-  // (0 = 4 Bytes are written)
-  // (1 = 32 Bytes are written)
-  if (length_of_data == 32)
-  {
-	zone |= 0b10000000; // set bit 7
-  }
-  else if (length_of_data == 4)
+  if (_faultCorrupt & (1 << FAULT_EXEC_ERROR))
   {
-	zone &= ~0b10000000; // clear bit 7
-  }
-  else
-  {
-	return false; // invalid length, abort.
+    // what the IC sends when a command fails: count, status, CRC. Wire still hands us all the bytes
+    // we asked for, and the IC has nothing more to send, so the rest reads as 0xFF.
+    memset(inputBuffer, 0xFF, countGlobal);
+    inputBuffer[RESPONSE_COUNT_INDEX] = RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE;
+    inputBuffer[RESPONSE_SIGNAL_INDEX] = FAULT_STATUS_EXEC_ERROR;
+    atca_calculate_crc(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE, inputBuffer);
+    memcpy(&inputBuffer[RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE], crc, CRC_SIZE);
   }
 
-  if (!sendCommand(COMMAND_OPCODE_WRITE, zone, address, data, length_of_data))
-    return false;
+  if ((_faultCorrupt & (1 << FAULT_CRC)) && countGlobal)
+    inputBuffer[countGlobal - 1] ^= 0x01;
 
-  delay(26); // time for IC to process command and exectute
+  if (_faultCorrupt & (1 << FAULT_TRUNCATE))
+    countGlobal -= (_faultTruncate < countGlobal) ? _faultTruncate : countGlobal;
 
-  // Now let's read back from the IC and see if it reports back good things.
-  countGlobal = 0;
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
-    return false;
+  _faultCorrupt = 0;
+}
+#endif
 
-  idleMode();
+/** \brief
+
+	setTraceCallback(void (*callback)(const ATECCX08A_TraceEvent *event, void *context), void *context)
+
+	Registers a function that is called at the beginning and end of every protocol phase:
+	wake, frame write, execution wait, response read, CRC check, idle and sleep, and whole operations
+	(TRACE_PHASE_SESSION: a session, or a single command sent outside one, from sendCommand() to idle).
+	Each event carries the I2C address of the device, the opcode and param2 (the slot, for key commands)
+	of the command in progress, and a micros() timestamp.
+	Write the events to a Chrome JSON / Perfetto trace (Linux), or to a RAM buffer (MCU),
+	to see exactly where the time of an operation is spent.
+	Keep the callback short, since it runs in the middle of the bus traffic.
+	Pass NULL to turn tracing off again (the default).
+*/
 
-  if (!checkCount() || !checkCrc())
-    return false;
+void ATECCX08A::setTraceCallback(void (*callback)(const ATECCX08A_TraceEvent *event, void *context), void *context)
+{
+  _traceCallback = callback;
+  _traceContext = context;
+}
 
-  // If we hear a "0x00", that means it had a successful write
-  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_WRITE)
-  {
-    return false;
-  }
+// ends the TRACE_PHASE_SESSION that sendCommand() opened for a single command, if any
+void ATECCX08A::endCommandSpan()
+{
+  if (!_traceCommandSpan)
+    return;
 
+  _traceCommandSpan = false;
+  trace(TRACE_PHASE_SESSION, false);
+}
 
-  return true;
+void ATECCX08A::trace(uint8_t phase, boolean begin)
+{
+  if (!_traceCallback)
+    return;
+
+  ATECCX08A_TraceEvent event;
+  event.phase = phase;
+  event.begin = begin;
+  event.address = _i2caddr;
+  event.opcode = _traceOpcode;
+  event.param2 = _traceParam2;
+  event.micros = micros();
+
+  _traceCallback(&event, _traceContext);
 }
 
 /** \brief
 
-	createSignature(uint8_t *data, uint16_t slot)
-
-    Creates a 64-byte ECC signature on 32 bytes of data.
-	Defaults to use private key located in slot 0.
-	Your signature will be available at global variable signature[].
+	setLatencyHistogram(uint8_t opcode, ATECCX08A_Histogram *histogram)
 
-	Note, the IC actually needs you to store your data in a temporary memory location
-	called TempKey. This function first loads TempKey, and then signs TempKey. Then it
-	receives the signature and copies it to signature[].
+	Records the latency of every command with this opcode (e.g. COMMAND_OPCODE_SIGN) into histogram,
+	from the moment sendCommand() starts (including the wake) until the response has been read.
+	The histogram is a fixed size (~185 bytes) and never allocates, and you provide it, so you only
+	pay for the opcodes you care about. Pass NULL to stop recording.
+	Returns without doing anything for an opcode this library doesn't send.
 */
 
-boolean ATECCX08A::createSignature(uint8_t *data, uint16_t slot)
+void ATECCX08A::setLatencyHistogram(uint8_t opcode, ATECCX08A_Histogram *histogram)
 {
-  if (!loadTempKey(data) || !signTempKey(slot))
-    return false;
+  uint8_t index = opcodeIndex(opcode);
 
-  return true;
+  if (index < OPCODE_INDEX_COUNT)
+    _latencyHistograms[index] = histogram;
 }
 
 /** \brief
 
-	loadTempKey(uint8_t *data)
-
-	Writes 32 bytes of data to memory location "TempKey" on the IC.
-	Note, the data is provided externally by you, the user, and is included in the
-	command NONCE.
+	setEnergyStats(ATECCX08A_EnergyStats *stats)
 
-    We will use the NONCE command in passthrough mode to load tempKey with our data (aka message).
-    Note, the datasheet warns that this does not provide protection agains replay attacks,
-    but we will protect again this because our server (Bob) is going to send us it's own unique random TOKEN,
-    when it requests data, and this will allow us to create a unique data + signature for every communication.
+	Starts keeping track of how long the IC spends in each power state (active, idle, sleep),
+	and how long each command keeps it busy, in stats (which you provide, ~160 bytes).
+	Combined with the current model (see setCurrentModel()), energyPerCommand() and energyTotal()
+	turn these times into an estimate of the energy used, to tune power policy against.
+	The IC falling asleep on its own (watchdog) is estimated with ATRCC508A_WATCHDOG_MS.
+	Pass NULL to stop.
 */
 
-boolean ATECCX08A::loadTempKey(uint8_t *data)
+void ATECCX08A::setEnergyStats(ATECCX08A_EnergyStats *stats)
 {
-  if (!sendCommand(COMMAND_OPCODE_NONCE, NONCE_MODE_PASSTHROUGH, 0x0000, data, 32))
-    return false;
-
-  // note, param2 is 0x0000 (and param1 is PASSTHROUGH), so OutData will be just a single byte of zero upon completion.
-  // see ds pg 77 for more info
-
-  delay(7); // time for IC to process command and exectute
+  _energyStats = stats;
 
-  // Now let's read back from the IC.
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
-    return false; // responds with "0x00" if NONCE executed properly
+  if (stats)
+  {
+    memset(stats, 0, sizeof(ATECCX08A_EnergyStats));
+    _powerStateMicros = micros();
+    _powerStateMillis = millis();
+  }
+}
 
-  idleMode();
+/** \brief
 
-  if (!checkCount() || !checkCrc())
-    return false;
+	setCurrentModel(uint32_t activeNanoamps, uint32_t idleNanoamps, uint32_t sleepNanoamps, uint16_t supplyMillivolts)
 
-  // If we hear a "0x00", that means it had a successful nonce
-  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_TEMPKEY)
-    return false;
+	Sets the supply current drawn in each power state, and the supply voltage, used for energy estimates.
+	The defaults are 14mA active, 800uA idle (see idleMode()), 150nA sleep at 3.3V.
+	Measure your own board for real numbers.
+*/
 
-  return true;
+void ATECCX08A::setCurrentModel(uint32_t activeNanoamps, uint32_t idleNanoamps, uint32_t sleepNanoamps, uint16_t supplyMillivolts)
+{
+  _currentNanoamps[POWER_STATE_ACTIVE] = activeNanoamps;
+  _currentNanoamps[POWER_STATE_IDLE] = idleNanoamps;
+  _currentNanoamps[POWER_STATE_SLEEP] = sleepNanoamps;
+  _supplyMillivolts = supplyMillivolts;
 }
 
 /** \brief
 
-	signTempKey(uint16_t slot)
-
-	Create a 64 byte ECC signature for the contents of TempKey using the private key in Slot.
-	Default slot is 0
+	energyPerCommand(uint8_t opcode)
 
-	The response from this command (the signature) is stored in global varaible signature[].
+	Returns the estimated average energy (in micro Joules) of one command with this opcode
+	(e.g. COMMAND_OPCODE_SIGN), while the IC was active for it. 0 if none have been recorded.
 */
 
-boolean ATECCX08A::signTempKey(uint16_t slot)
+float ATECCX08A::energyPerCommand(uint8_t opcode)
 {
-  if (!sendCommand(COMMAND_OPCODE_SIGN, SIGN_MODE_TEMPKEY, slot))
-    return false;
+  uint8_t index = opcodeIndex(opcode);
 
-  delay(60); // time for IC to process command and exectute
+  if (!_energyStats || index >= OPCODE_INDEX_COUNT || _energyStats->commandCount[index] == 0)
+    return 0;
 
-  // Now let's read back from the IC.
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + SIGNATURE_SIZE + CRC_SIZE)) // signature (64), plus crc (2), plus count (1)
-    return false;
+  // us * nA * mV = 1e-18 J = 1e-12 uJ
+  float averageMicros = (float)_energyStats->commandMicros[index] / _energyStats->commandCount[index];
+  return averageMicros * _currentNanoamps[POWER_STATE_ACTIVE] * _supplyMillivolts * 1e-12;
+}
 
-  idleMode();
+/** \brief
 
-  // update signature[] array and print it to serial terminal nicely formatted for easy copy/pasting between sketches
-  if (!checkCount() || !checkCrc())  // check that it was a good message
-    return false;
+	energyTotal()
 
-   // we don't need the count value (which is currently the first byte of the inputBuffer)
-  for (int i = 0 ; i < SIGNATURE_SIZE ; i++) // for loop through to grab all but the first position (which is "count" of the message)
-  {
-    signature[i] = inputBuffer[RESPONSE_COUNT_SIZE + i];
-  }
+	Returns the estimated total energy (in micro Joules) used by the IC in all power states,
+	since setEnergyStats() was called.
+*/
 
-  _debugSerial->println();
-  _debugSerial->println("uint8_t signature[64] = {");
-  for (int i = 0; i < sizeof(signature) ; i++)
+float ATECCX08A::energyTotal()
+{
+  if (!_energyStats)
+    return 0;
+
+  setPowerState(_powerState); // bring the time in the current state up to now
+
+  float total = 0;
+  for (int state = POWER_STATE_SLEEP; state <= POWER_STATE_ACTIVE; state++)
   {
-    _debugSerial->print("0x");
-    if ((signature[i] >> 4) == 0) _debugSerial->print("0"); // print preceeding high nibble if it's zero
-    _debugSerial->print(signature[i], HEX);
-    if (i != 63) _debugSerial->print(", ");
-    if ((63-i) % 16 == 0) _debugSerial->println();
+    total += (float)_energyStats->stateMicros[state] * _currentNanoamps[state] * _supplyMillivolts * 1e-12;
   }
-  _debugSerial->println("};");
 
-	return true;
+  return total;
 }
 
 /** \brief
 
-	verifySignature(uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+	setDutyBudget(uint8_t dutyClass, ATECCX08A_DutyBudget *budget, uint16_t msPerSecond, uint16_t burstMs, uint8_t policy)
 
-	Verifies a ECC signature using the message, signature and external public key.
-	Returns true if successful.
+	Limits how much of the time the IC may spend executing commands of one class (DUTY_CLASS_...),
+	to keep it (and your supply) from running flat out under sustained load. This is a token bucket:
+	it fills with msPerSecond of active time every second, up to burstMs, and each command takes out
+	its execution time (see executionTime()). e.g. msPerSecond = 300 keeps signing at ~30% duty,
+	while burstMs = 250 still lets 4 signatures through back to back.
 
-	Note, it acutally uses loadTempKey, then uses the verify command in "external public key" mode.
+	When the bucket is empty, DUTY_POLICY_WAIT delays the command until it has filled up enough
+	(but never past the deadline, see setDeadline()). DUTY_POLICY_REJECT fails it right away with
+	lastStatus set to ATECC_STATUS_THROTTLED, so you can do the work on the host instead
+	(a software verify, random bytes from tryGetRandom(), etc.) and try the IC again later.
+
+	You provide the budget, which also keeps count of how often the limit was hit. Pass NULL to
+	remove the limit for that class.
 */
 
-boolean ATECCX08A::verifySignature(uint8_t *message, uint8_t *signature, uint8_t *publicKey)
+void ATECCX08A::setDutyBudget(uint8_t dutyClass, ATECCX08A_DutyBudget *budget, uint16_t msPerSecond, uint16_t burstMs, uint8_t policy)
 {
-  uint8_t data_sigAndPub[128];
+  if (dutyClass >= DUTY_CLASS_COUNT)
+    return;
 
-  // first, let's load the message into TempKey on the device, this uses NONCE command in passthrough mode.
-  if (!loadTempKey(message))
+  _dutyBudgets[dutyClass] = budget;
+
+  if (budget)
   {
-    _debugSerial->println("Load TempKey Failure");
-    return false;
+    memset(budget, 0, sizeof(ATECCX08A_DutyBudget));
+    budget->msPerSecond = msPerSecond;
+    budget->burstMs = burstMs;
+    budget->policy = policy;
+    budget->tokens = (uint32_t)burstMs * 1000; // start full
+    budget->lastRefill = millis();
+    budget->since = budget->lastRefill;
   }
+}
 
-  // We can only send one *single* data array to sendCommand as Param2, so we need to combine signature and public key.
-  memcpy(&data_sigAndPub[0], &signature[0], SIGNATURE_SIZE);	// append signature
-  memcpy(&data_sigAndPub[SIGNATURE_SIZE], &publicKey[0], PUBLIC_KEY_SIZE);	// append external public key
+/** \brief
 
-  if (!sendCommand(COMMAND_OPCODE_VERIFY, VERIFY_MODE_EXTERNAL, VERIFY_PARAM2_KEYTYPE_ECC, data_sigAndPub, sizeof(data_sigAndPub)))
-    return false;
+	dutyUtilization(uint8_t dutyClass)
 
-  delay(58); // time for IC to process command and exectute
+	Returns the fraction (0.0 - 1.0) of wall time the IC spent on commands of this class since
+	setDutyBudget(). If this sits at msPerSecond/1000 and the budget's throttled count keeps
+	going up, you are budget limited.
+*/
 
-  // Now let's read back from the IC.
-  if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
-    return false;
+float ATECCX08A::dutyUtilization(uint8_t dutyClass)
+{
+  if (dutyClass >= DUTY_CLASS_COUNT || !_dutyBudgets[dutyClass])
+    return 0;
 
-  idleMode();
+  unsigned long elapsed = millis() - _dutyBudgets[dutyClass]->since;
+  if (elapsed == 0)
+    return 0;
 
-  if (!checkCount() || !checkCrc())
-    return false;
+  return (float)_dutyBudgets[dutyClass]->activeMillis / elapsed;
+}
 
-  // If we hear a "0x00", that means it had a successful verify
-  if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_VERIFY)
-    return false;
+/** \brief
 
-  return true;
-}
+	dutyClass(uint8_t opcode)
 
-boolean ATECCX08A::sha256(uint8_t * plain, size_t len, uint8_t * hash)
+	Returns the DUTY_CLASS_ of a command, the expensive public key commands,
+	the cheaper symmetric ones, and everything else.
+*/
+
+uint8_t ATECCX08A::dutyClass(uint8_t opcode)
 {
-	int i;
-	size_t chunks = len / SHA_BLOCK_SIZE + !!(len % SHA_BLOCK_SIZE);
-  if((len % SHA_BLOCK_SIZE) == 0) chunks += 1; // END command can only accept up to 63 bytes, so we must add a "blank chunk" for the end command
+  switch (opcode)
+  {
+    case COMMAND_OPCODE_SIGN:
+    case COMMAND_OPCODE_VERIFY:
+    case COMMAND_OPCODE_GENKEY:
+    case COMMAND_OPCODE_ECDH:
+      return DUTY_CLASS_ASYMMETRIC;
+    case COMMAND_OPCODE_SHA:
+    case COMMAND_OPCODE_NONCE:
+    case COMMAND_OPCODE_RANDOM:
+      return DUTY_CLASS_SYMMETRIC;
+    default:
+      return DUTY_CLASS_OTHER;
+  }
+}
 
-  // Serial.print("chunks:");
-  // Serial.println(chunks);
+/** \brief
 
-	if (!sendCommand(COMMAND_OPCODE_SHA, SHA_START, 0))
-		return false;
+	dutyAllows(uint8_t opcode)
 
-	/* Divide into blocks of 64 bytes per chunk */
-	for (i = 0; i < chunks; ++i)
-	{
-		size_t data_size = SHA_BLOCK_SIZE;
-		uint8_t chunk[SHA_BLOCK_SIZE];
+	Refills the bucket of the command's class, then takes its execution time out of it,
+	waiting for it to refill first if needed (DUTY_POLICY_WAIT).
+	Returns false (lastStatus ATECC_STATUS_THROTTLED or ATECC_STATUS_TIMEOUT) if the command may not run.
+*/
 
-		delay(9);
+boolean ATECCX08A::dutyAllows(uint8_t opcode)
+{
+  ATECCX08A_DutyBudget *budget = _dutyBudgets[dutyClass(opcode)];
+
+  if (!budget)
+    return true;
+
+  uint32_t capacity = (uint32_t)budget->burstMs * 1000;
+  uint32_t cost = (uint32_t)executionTime(opcode) * 1000;
+  if (cost > capacity)
+    cost = capacity; // a command longer than the burst runs whenever the bucket is full
+
+  unsigned long now = millis();
+  unsigned long elapsed = now - budget->lastRefill;
+  budget->lastRefill = now;
+  if (elapsed > 60000UL)
+    elapsed = 60000UL; // long since full anyway, and keeps the math below in 32 bits
+  budget->tokens += elapsed * budget->msPerSecond; // ms * (ms/s) = us
+  if (budget->tokens > capacity)
+    budget->tokens = capacity;
+
+  if (budget->tokens < cost)
+  {
+    budget->throttled++;
 
-		if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SIGNAL_SIZE + CRC_SIZE))
-			return false;
+    if (budget->policy == DUTY_POLICY_REJECT || budget->msPerSecond == 0)
+    {
+      budget->rejected++;
+      lastStatus = ATECC_STATUS_THROTTLED;
+      return false;
+    }
 
-		idleMode();
+    unsigned long wait = (cost - budget->tokens + budget->msPerSecond - 1) / budget->msPerSecond;
 
-		if (!checkCount() || !checkCrc())
-			return false;
+    if (!deadlineAllows(wait + executionTime(opcode)))
+      return false;
 
-		// If we hear a "0x00", that means it had a successful load
-		if (inputBuffer[RESPONSE_SIGNAL_INDEX] != ATRCC508A_SUCCESSFUL_SHA)
-			return false;
+    delay(wait);
 
-		if (i + 1 == chunks) // if we're on the last chunk, there will be a remainder or 0 (and 0 is okay for an end command)
-			data_size = len % SHA_BLOCK_SIZE;
+    budget->waitMillis += wait;
+    budget->lastRefill = millis();
+    budget->tokens += wait * budget->msPerSecond;
+  }
 
-    // Serial.print("chunk:");
-    // Serial.println(i);
-    // Serial.print("data_size:");
-    // Serial.println(data_size);
-    // Serial.print("update vs end:");
-    // Serial.println((i + 1 != chunks) ? SHA_UPDATE : SHA_END);
+  budget->tokens -= cost;
+  budget->granted++;
+  budget->activeMillis += executionTime(opcode);
 
-		/* Send next */
-		if (!sendCommand(COMMAND_OPCODE_SHA, (i + 1 != chunks) ? SHA_UPDATE : SHA_END, data_size, plain + i * SHA_BLOCK_SIZE, data_size))
-			return false;
-	}
+  return true;
+}
 
-	/* Read digest */
-	delay(9);
+/** \brief
 
-	if (!receiveResponseData(RESPONSE_COUNT_SIZE + RESPONSE_SHA_SIZE + CRC_SIZE))
-		return false;
+	setPowerState(uint8_t state)
 
-	idleMode();
+	Adds the time spent in the previous power state to the energy stats, and moves on to state.
+	An IC left awake or idle falls asleep after the watchdog timeout, so anything past that counts as sleep.
+*/
 
-	if (!checkCount() || !checkCrc())
-		return false;
+void ATECCX08A::setPowerState(uint8_t state)
+{
+  if (_energyStats)
+  {
+    uint64_t elapsed = micros() - _powerStateMicros;
+    unsigned long elapsedMillis = millis() - _powerStateMillis;
 
-	/* Copy digest */
-	for (i = 0; i < SHA256_SIZE; ++i)
-	{
-		hash[i] = inputBuffer[RESPONSE_SHA_INDEX + i];
-	}
+    if (elapsedMillis > 60000UL) // micros() wraps after ~70 minutes, so use millis() for long stretches
+      elapsed = (uint64_t)elapsedMillis * 1000;
 
-	return true;
+    if (_powerState != POWER_STATE_SLEEP && elapsed > (uint64_t)ATRCC508A_WATCHDOG_MS * 1000)
+    {
+      _energyStats->stateMicros[POWER_STATE_SLEEP] += elapsed - (uint64_t)ATRCC508A_WATCHDOG_MS * 1000;
+      elapsed = (uint64_t)ATRCC508A_WATCHDOG_MS * 1000;
+    }
+
+    _energyStats->stateMicros[_powerState] += elapsed;
+  }
+
+  _powerState = state;
+  _powerStateMicros = micros();
+  _powerStateMillis = millis();
 }
-/** \brief
 
-	writeConfigSparkFun()
+/** \brief
 
-	Writes the necessary configuration settings to the IC in order to work with the SparkFun Arduino Library examples.
-	For key slots 0 and 1, this enables ECC private key pairs,public key generation, and external signature verifications.
+	opcodeIndex(uint8_t opcode)
 
-	Returns true if write commands were successful.
+	Maps the opcodes this library sends to 0 - (OPCODE_INDEX_COUNT - 1), for per-command arrays.
+	Returns OPCODE_INDEX_COUNT for anything else.
 */
 
-boolean ATECCX08A::writeConfigSparkFun()
+uint8_t ATECCX08A::opcodeIndex(uint8_t opcode)
 {
-  // keep track of our write command results.
-  boolean result1;
-  boolean result2;
+  switch (opcode)
+  {
+    case COMMAND_OPCODE_INFO: return 0;
+    case COMMAND_OPCODE_LOCK: return 1;
+    case COMMAND_OPCODE_RANDOM: return 2;
+    case COMMAND_OPCODE_READ: return 3;
+    case COMMAND_OPCODE_WRITE: return 4;
+    case COMMAND_OPCODE_SHA: return 5;
+    case COMMAND_OPCODE_GENKEY: return 6;
+    case COMMAND_OPCODE_NONCE: return 7;
+    case COMMAND_OPCODE_SIGN: return 8;
+    case COMMAND_OPCODE_VERIFY: return 9;
+    case COMMAND_OPCODE_ECDH: return 10;
+    default: return OPCODE_INDEX_COUNT;
+  }
+}
 
-  // set keytype on slot 0 and 1 to 0x3300
-  // Lockable, ECC, PuInfo set (public key always allowed to be generated), contains a private Key
-  uint8_t data1[] = {0x33, 0x00, 0x33, 0x00}; // 0x3300 sets the keyconfig.keyType, see datasheet pg 20
-  result1 = write(ZONE_CONFIG, (96 / 4), data1, 4);
-  // set slot config on slot 0 and 1 to 0x8320
-  // EXT signatures, INT signatures, IsSecret, Write config never
-  uint8_t data2[] = {0x83, 0x20, 0x83, 0x20}; // for slot config bit definitions see datasheet pg 20
-  result2 = write(ZONE_CONFIG, (20 / 4), data2, 4);
+/** \brief
 
-  return (result1 && result2);
+	ATECCX08A_Histogram
+
+	Fixed size, allocation free, log-bucket latency histogram (in the spirit of HDR histograms).
+	Values below 4 get their own bucket, after that every power of 2 is split into 4 buckets,
+	so any value is within ~25% of its bucket. Recording is a count-leading-zeros and a few shifts.
+	Bucket counts are 16 bits; when one would overflow, every bucket is halved, which keeps the shape
+	(and so the percentiles) while slowly forgetting old samples.
+	Histograms from several devices can be added together with merge().
+*/
+
+void ATECCX08A_Histogram::clear()
+{
+  memset(buckets, 0, sizeof(buckets));
+  count = 0;
+  highest = 0;
 }
 
-/** \brief
+uint8_t ATECCX08A_Histogram::bucketIndex(uint32_t value)
+{
+  if (value < HISTOGRAM_SUB_BUCKETS)
+    return value;
 
-	sendCommand(uint8_t command_opcode, uint8_t param1, uint16_t param2, uint8_t *data, size_t length_of_data)
+  uint8_t msb = (sizeof(unsigned long) * 8 - 1) - __builtin_clzl(value); // position of the highest set bit, 2 or more here
+  uint16_t index = (msb - 1) * HISTOGRAM_SUB_BUCKETS + ((value >> (msb - 2)) & (HISTOGRAM_SUB_BUCKETS - 1));
 
-	Generic function for sending commands to the IC.
+  if (index >= HISTOGRAM_BUCKETS)
+    index = HISTOGRAM_BUCKETS - 1;
 
-	This function handles creating the "total transmission" to the IC.
-	This contains WORD_ADDRESS_VALUE, COUNT, OPCODE, PARAM1, PARAM2, DATA (optional), and CRCs.
+  return index;
+}
 
-	Note, it always calls the "wake()" function, assuming that you have let the IC fall asleep (default 1.7 sec)
+uint32_t ATECCX08A_Histogram::bucketHighest(uint8_t index)
+{
+  if (index < HISTOGRAM_SUB_BUCKETS)
+    return index;
 
-	Note, for anything other than a command (reset, sleep and idle), you need a different "Word Address Value",
-	So those specific transmissions are handled in unique functions.
-*/
+  uint8_t msb = index / HISTOGRAM_SUB_BUCKETS + 1;
+  uint32_t lowest = (uint32_t)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS) << (msb - 2);
 
-boolean ATECCX08A::sendCommand(uint8_t command_opcode, uint8_t param1, uint16_t param2, uint8_t *data, size_t length_of_data)
+  return lowest + ((uint32_t)1 << (msb - 2)) - 1;
+}
+
+void ATECCX08A_Histogram::record(uint32_t value)
 {
-  // build packet array (total_transmission) to send a communication to IC, with opcode COMMAND
-  // It expects to see: word address, count, command opcode, param1, param2, data (optional), CRC[0], CRC[1]
-  uint8_t transmission_without_crc_length;
-  uint8_t total_transmission_length;
-  uint8_t total_transmission[UINT8_MAX];
-  uint8_t packet_to_CRC[UINT8_MAX]; // minus word address (1) and crc (2).
+  uint8_t index = bucketIndex(value);
 
-  /* Validate no integer overflow */
-  if (length_of_data > UINT8_MAX - ATRCC508A_PROTOCOL_OVERHEAD)
-    return false;
+  if (buckets[index] == UINT16_MAX)
+  {
+    count = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+      buckets[i] >>= 1;
+      count += buckets[i];
+    }
+  }
 
-  total_transmission_length = length_of_data + ATRCC508A_PROTOCOL_OVERHEAD;
+  buckets[index]++;
+  count++;
+  if (value > highest) highest = value;
+}
 
-  total_transmission[ATRCC508A_PROTOCOL_FIELD_COMMAND] = WORD_ADDRESS_VALUE_COMMAND;      // word address value (type command)
-  total_transmission[ATRCC508A_PROTOCOL_FIELD_LENGTH] = total_transmission_length - ATRCC508A_PROTOCOL_FIELD_SIZE_LENGTH;    // count, does not include itself, so "-1"
-  total_transmission[ATRCC508A_PROTOCOL_FIELD_OPCODE] = command_opcode;                   // command
-  total_transmission[ATRCC508A_PROTOCOL_FIELD_PARAM1] = param1;                           // param1
-  memcpy(&total_transmission[ATRCC508A_PROTOCOL_FIELD_PARAM2], &param2, sizeof(param2));  // append param2
-  memcpy(&total_transmission[ATRCC508A_PROTOCOL_FIELD_DATA], &data[0], length_of_data);   // append data
+void ATECCX08A_Histogram::merge(const ATECCX08A_Histogram &other)
+{
+  count = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    uint32_t sum = (uint32_t)buckets[i] + other.buckets[i];
+    buckets[i] = (sum > UINT16_MAX) ? UINT16_MAX : sum;
+    count += buckets[i];
+  }
 
-  // update CRCs
-  transmission_without_crc_length = total_transmission_length - (ATRCC508A_PROTOCOL_FIELD_SIZE_COMMAND + ATRCC508A_PROTOCOL_FIELD_SIZE_CRC); // copy over just what we need to CRC starting at index 1
+  if (other.highest > highest) highest = other.highest;
+}
 
-  memcpy(packet_to_CRC, &total_transmission[ATRCC508A_PROTOCOL_FIELD_LENGTH], transmission_without_crc_length);
+/** \brief
 
-  //  _debugSerial->println("packet_to_CRC: ");
-  //  for (int i = 0; i < sizeof(packet_to_CRC) ; i++)
-  //  {
-  //  _debugSerial->print(packet_to_CRC[i], HEX);
-  //  _debugSerial->print(",");
-  //  }
-  //  _debugSerial->println();
+	percentile(float percent)
 
-  atca_calculate_crc(transmission_without_crc_length, packet_to_CRC); // count includes crc[0] and crc[1], so we must subtract 2 before creating crc
-  //_debugSerial->println(crc[0], HEX);
-  //_debugSerial->println(crc[1], HEX);
+	Returns the value that percent (0-100) of the recorded values are at or below,
+	rounded up to the top of its bucket (but never more than the largest value recorded).
+	Returns 0 if nothing has been recorded.
+*/
 
-  memcpy(&total_transmission[total_transmission_length - ATRCC508A_PROTOCOL_FIELD_SIZE_CRC], crc, ATRCC508A_PROTOCOL_FIELD_SIZE_CRC);  // append crcs
+uint32_t ATECCX08A_Histogram::percentile(float percent)
+{
+  if (count == 0)
+    return 0;
 
-  wakeUp();
+  uint32_t target = (uint32_t)(count * percent / 100.0 + 0.5);
+  if (target < 1) target = 1;
+  if (target > count) target = count;
 
-  _i2cPort->beginTransmission(_i2caddr);
-  _i2cPort->write(total_transmission, total_transmission_length);
-  _i2cPort->endTransmission();
+  uint32_t seen = 0;
+  for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+  {
+    seen += buckets[i];
+    if (seen >= target)
+    {
+      uint32_t top = bucketHighest(i);
+      return (top < highest) ? top : highest;
+    }
+  }
 
-  return true;
+  return highest;
 }
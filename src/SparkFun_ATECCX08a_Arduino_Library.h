@@ -45,9 +45,11 @@
 #define SERIAL_NUMBER_SIZE   10
 
 #define RANDOM_BYTES_BLOCK_SIZE 32
+#define RANDOM_POOL_MAX_SIZE 128 // the ring buffer indexes run freely from 0-255, see setRandomPool()
 #define SHA256_SIZE          32
 #define PUBLIC_KEY_SIZE      64
 #define SIGNATURE_SIZE       64
+#define SHARED_SECRET_SIZE   32
 #define BUFFER_SIZE          128
 
 #define DATA_ZONE_SLOTS	     16
@@ -59,6 +61,8 @@
 #define LIMITED_USE(SCONFIG)	(SCONFIG & 0b0000000000100000)
 #define NO_MAC(SCONFIG)			(SCONFIG & 0b0000000000010000)
 #define READ_KEY(SCONFIG)		(SCONFIG & 0b0000000000001111)
+#define WRITE_CONFIG_GENKEY		0b0010000000000000 // ECC private key slot: GenKey may create a new key, datasheet pg 21
+#define WRITE_CONFIG_PRIVWRITE	0b0100000000000000 // ECC private key slot: PrivWrite may write a new key
 
 /* Response signals always come after the first count byte */
 #define RESPONSE_COUNT_INDEX 0
@@ -95,15 +99,49 @@
 #define ATRCC508A_SUCCESSFUL_WAKEUP  0x11
 #define ATRCC508A_SUCCESSFUL_GETINFO 0x50 /* Revision number */
 
+/* Command execution times (ms), maximums from the datasheet */
+#define EXECUTION_TIME_INFO		1
+#define EXECUTION_TIME_LOCK		32
+#define EXECUTION_TIME_RANDOM	23
+#define EXECUTION_TIME_READ		1
+#define EXECUTION_TIME_WRITE	26
+#define EXECUTION_TIME_SHA		9
+#define EXECUTION_TIME_GENKEY	115
+#define EXECUTION_TIME_NONCE	7
+#define EXECUTION_TIME_SIGN		60
+#define EXECUTION_TIME_VERIFY	58
+#define EXECUTION_TIME_ECDH		58
+
+/* Library status, see lastStatus */
+#define ATECC_STATUS_OK			0
+#define ATECC_STATUS_TIMEOUT	1 // refused or abandoned because of the deadline, see setDeadline()
+#define ATECC_STATUS_COMM_ERROR	2 // bad count or CRC in the response
+#define ATECC_STATUS_CANCELLED	3 // stopped by cancel()
+#define ATECC_STATUS_THROTTLED	4 // refused by the duty-cycle limiter, see setDutyBudget()
+#define ATECC_STATUS_EXEC_ERROR	5 // the IC answered with an error status instead of the data
+#define ATECC_STATUS_IN_SESSION	6 // can't be done inside beginSession()/endSession(), e.g. setI2CAddress()
+
 /* Receive constants */
 #define ATRCC508A_MAX_REQUEST_SIZE 32
 #define ATRCC508A_MAX_RETRIES 20
 
+/* Sessions: the watchdog puts the IC to sleep 1.3-1.7sec after wake, so re-wake well before that */
+#define ATRCC508A_SESSION_REWAKE_MS 1000
+
+/* Repeat getInfo() calls within this window share the last answer */
+#define ATRCC508A_COALESCE_MS 50
+#define PUBLIC_KEY_CACHE_EMPTY 0xFFFF
+
+/* Bus recovery, see setBusRecoveryPins() */
+#define BUS_RECOVERY_NO_PIN 0xFF
+#define BUS_RECOVERY_CLOCKS 9 // enough to finish any byte a slave is stuck in
+
 /* configZone EEPROM mapping */
 #define CONFIG_ZONE_READ_SIZE    32
 #define CONFIG_ZONE_SERIAL_PART0    0
 #define CONFIG_ZONE_SERIAL_PART1    8
 #define CONFIG_ZONE_REVISION_NUMBER 4
+#define CONFIG_ZONE_I2C_ADDRESS 16
 #define CONFIG_ZONE_SLOT_CONFIG 20
 #define CONFIG_ZONE_OTP_LOCK     86
 #define CONFIG_ZONE_LOCK_STATUS  87
@@ -121,6 +159,7 @@
 #define WORD_ADDRESS_VALUE_COMMAND 	0x03	// This is the "command" word address,
 //this tells the IC we are going to send a command, and is used for most communications to the IC
 #define WORD_ADDRESS_VALUE_IDLE 0x02 // used to enter idle mode
+#define WORD_ADDRESS_VALUE_SLEEP 0x01 // used to enter sleep mode
 
 // COMMANDS (aka "opcodes" in the datasheet)
 #define COMMAND_OPCODE_INFO 	0x30 // Return device state information.
@@ -133,6 +172,7 @@
 #define COMMAND_OPCODE_NONCE 	0x16 //
 #define COMMAND_OPCODE_SIGN 	0x41 // Create an ECC signature with contents of TempKey and designated key slot
 #define COMMAND_OPCODE_VERIFY 	0x45 // takes an ECDSA <R,S> signature and verifies that it is correctly generated from a given message and public key
+#define COMMAND_OPCODE_ECDH 	0x43 // Generate an ECDH pre-master secret from a private key in a slot and another party's public key
 
 // Lock command PARAM1 zone options (aka Mode). more info at table on datasheet page 75
 // 		? _ _ _  _ _ _ _ 	Bits 7 verify zone summary, 1 = ignore summary and write to zone!
@@ -161,17 +201,34 @@
 #define KEY_CONFIG_OFFSET_PUB_INFO		1
 #define KEY_CONFIG_OFFSET_PRIVATE		0
 #define KEY_CONFIG_SET(data, config)	((data) << (config))
+#define KEY_CONFIG_GET(KCONFIG, config, mask)	(((KCONFIG) >> (config)) & (mask))
+
+#define KEY_TYPE_ECC					0b100 // P256 NIST ECC key, KeyConfig.KeyType, datasheet pg 20
+#define KEY_TYPE_AES					0b110
+#define KEY_TYPE_SHA					0b111 // SHA key or other data
 
 // GenKey command PARAM1 zone options (aka Mode). more info at table on datasheet page 71
 #define GENKEY_MODE_PUBLIC 			0b00000000
 #define GENKEY_MODE_NEW_PRIVATE 	0b00000100
 
+// Random command PARAM1 options (aka Mode). datasheet pg 81
+#define RANDOM_MODE_SEED_UPDATE		0b00000000 // Automatically update EEPROM seed only if necessary prior to random number generation.
+#define RANDOM_MODE_NO_SEED_UPDATE	0b00000001 // Generate a random number using the existing seed, no EEPROM write.
+
+// Seed update policy, see setRandomSeedPolicy()
+#define RANDOM_SEED_UPDATE_ALWAYS	0 // every draw uses RANDOM_MODE_SEED_UPDATE (default, same as older library versions)
+#define RANDOM_SEED_UPDATE_ONCE		1 // first draw after each wake from sleep updates the seed, later draws don't
+
 #define NONCE_MODE_PASSTHROUGH		0b00000011 // Operate in pass-through mode and Write TempKey with NumIn. datasheet pg 79
+#define NONCE_MODE_SEED_UPDATE		0b00000000 // Random mode, update EEPROM seed if necessary. TempKey = SHA256(RandOut, NumIn, 0x16, mode, 0x00). datasheet pg 79
+#define NONCE_MODE_NO_SEED_UPDATE	0b00000001 // Random mode, use the existing seed
+#define NONCE_NUMIN_SIZE			20 // NumIn is 20 bytes in random mode
 #define SIGN_MODE_TEMPKEY			0b10000000 // The message to be signed is in TempKey. datasheet pg 85
 #define VERIFY_MODE_EXTERNAL		0b00000010 // Use an external public key for verification, pass to command as data post param2, ds pg 89
 #define VERIFY_MODE_STORED			0b00000000 // Use an internally stored public key for verification, param2 = keyID, ds pg 89
 #define VERIFY_PARAM2_KEYTYPE_ECC 	0x0004 // When verify mode external, param2 should be KeyType, ds pg 89
 #define VERIFY_PARAM2_KEYTYPE_NONECC 	0x0007 // When verify mode external, param2 should be KeyType, ds pg 89
+#define ECDH_MODE_SLOT				0b00000000 // Use the private key in slot param2. Output in the clear, or to slot+1, according to SlotConfig. ds pg 70
 
 #define ZONE_CONFIG 0x00
 #define ZONE_OTP 0x01
@@ -187,6 +244,137 @@
 #define ADDRESS_CONFIG_READ_BLOCK_2 0x0010 // 00000000 00010000 // param2 (byte 0), address block bits: _ _ _ 1  0 _ _ _
 #define ADDRESS_CONFIG_READ_BLOCK_3 0x0018 // 00000000 00011000 // param2 (byte 0), address block bits: _ _ _ 1  1 _ _ _
 
+// Trace phases, see setTraceCallback()
+#define TRACE_PHASE_SESSION	0 // a whole operation: beginSession() to endSession(), or a single command to its idle
+#define TRACE_PHASE_WAKE	1 // wake pulse and wake response
+#define TRACE_PHASE_WRITE	2 // command frame written to the IC
+#define TRACE_PHASE_EXECUTE	3 // waiting for the IC to execute the command
+#define TRACE_PHASE_READ	4 // response read back (in up to 32 byte chunks)
+#define TRACE_PHASE_CRC		5 // response CRC calculation
+#define TRACE_PHASE_IDLE	6 // idle command
+#define TRACE_PHASE_SLEEP	7 // sleep command
+
+struct ATECCX08A_TraceEvent {
+	uint8_t phase; // TRACE_PHASE_...
+	boolean begin; // true at the start of the phase, false at the end
+	uint8_t address; // I2C address of the device
+	uint8_t opcode; // command in progress (last one sent)
+	uint16_t param2; // its param2, which is the slot for key commands
+	unsigned long micros; // timestamp
+};
+
+// Latency histogram: 4 log-spaced buckets per power of 2 (about 25% resolution), from 0 to ~8 seconds in microseconds
+#define HISTOGRAM_SUB_BUCKETS	4
+#define HISTOGRAM_BUCKETS		88
+
+struct ATECCX08A_Histogram {
+	uint16_t buckets[HISTOGRAM_BUCKETS];
+	uint32_t count;
+	uint32_t highest; // largest value recorded
+
+	void clear();
+	void record(uint32_t value);
+	void merge(const ATECCX08A_Histogram &other);
+	uint32_t percentile(float percent); // e.g. 50, 90, 99, 99.9
+	static uint8_t bucketIndex(uint32_t value);
+	static uint32_t bucketHighest(uint8_t index);
+};
+
+// Commands that can be tracked per opcode (histograms), see opcodeIndex()
+#define OPCODE_INDEX_COUNT 11
+
+// Chip power states, see setEnergyStats()
+#define POWER_STATE_SLEEP	0
+#define POWER_STATE_IDLE	1
+#define POWER_STATE_ACTIVE	2
+
+#define ATRCC508A_WATCHDOG_MS 1500 // typical watchdog timeout (1.3-1.7sec), after which an awake or idle IC falls asleep
+
+struct ATECCX08A_EnergyStats {
+	uint64_t stateMicros[3]; // time spent in each POWER_STATE_...
+	uint64_t commandMicros[OPCODE_INDEX_COUNT]; // time spent on each command (see opcodeIndex()), send to response
+	uint32_t commandCount[OPCODE_INDEX_COUNT];
+};
+
+// Duty-cycle limiter, see setDutyBudget()
+#define DUTY_CLASS_ASYMMETRIC	0 // SIGN, VERIFY, GENKEY, ECDH
+#define DUTY_CLASS_SYMMETRIC	1 // SHA, NONCE, RANDOM
+#define DUTY_CLASS_OTHER		2 // INFO, READ, WRITE, LOCK
+#define DUTY_CLASS_COUNT		3
+
+#define DUTY_POLICY_WAIT	0 // delay the command until there is budget for it
+#define DUTY_POLICY_REJECT	1 // fail right away with ATECC_STATUS_THROTTLED
+
+struct ATECCX08A_DutyBudget {
+	uint16_t msPerSecond; // active time allowed per second (1000 = no limit)
+	uint16_t burstMs; // bucket size, how much active time can be used back to back
+	uint8_t policy; // DUTY_POLICY_...
+	uint32_t tokens; // active time (us) available right now
+	unsigned long lastRefill; // millis()
+	unsigned long since; // millis() at setDutyBudget(), for dutyUtilization()
+	uint32_t granted; // commands let through
+	uint32_t throttled; // commands that found the bucket empty (waited or rejected)
+	uint32_t rejected;
+	uint32_t waitMillis; // total time spent waiting for budget
+	uint32_t activeMillis; // total active time charged
+};
+
+// One remembered (message, signature, public key) triple that verified successfully, see setVerifyCache()
+struct ATECCX08A_VerifyCacheEntry {
+	uint32_t tag; // FNV-1a hash of the whole triple, so most misses are rejected without a full compare
+	uint32_t lastUsed; // LRU stamp, 0 = empty entry
+	uint8_t message[SHA256_SIZE];
+	uint8_t signature[SIGNATURE_SIZE];
+	uint8_t publicKey[PUBLIC_KEY_SIZE];
+};
+
+// Fault injection, see setFaultInjection()
+// Test-only, so it is left out unless the library is built with ATECCX08A_FAULT_INJECTION defined
+// (a compiler flag, e.g. -DATECCX08A_FAULT_INJECTION, since a #define in a sketch doesn't reach the library)
+#ifdef ATECCX08A_FAULT_INJECTION
+#define FAULT_NACK			0 // the next count polls for the response get no answer
+#define FAULT_CRC			1 // a bit of the response CRC gets flipped
+#define FAULT_TRUNCATE		2 // the last count bytes of the response are lost
+#define FAULT_EXEC_ERROR	3 // the IC answers with an execution error status instead
+#define FAULT_WATCHDOG		4 // the IC falls asleep (as if its watchdog expired) right before the next command
+#define FAULT_BUS_HANG		5 // the next count wakes get no answer
+
+#define FAULT_STATUS_EXEC_ERROR	0x0F // status byte the IC sends when a command fails to execute
+#define FAULT_NACK_US			100 // time an unanswered poll takes on the bus (address + NACK at 100KHz)
+
+struct ATECCX08A_Fault {
+	uint8_t type; // FAULT_...
+	uint8_t count; // polls (NACK), bytes (TRUNCATE) or wakes (BUS_HANG)
+	uint16_t probability; // chance for each response, out of 65536 (0 = use the schedule instead)
+	uint16_t at; // schedule: first response to hit, counted from setFaultInjection() (1 = the next one)
+	uint16_t every; // schedule: and then every this many responses (0 = only once)
+	uint16_t fired; // number of times injected
+};
+#endif
+
+// Identity of an IC, to keep in host non-volatile memory for a fast boot, see saveBootCache()
+#define BOOT_CACHE_MAGIC 0x41544331 // "ATC1", change with the layout below
+
+struct ATECCX08A_BootCache {
+	uint32_t magic;
+	uint8_t address;
+	uint8_t configZone[CONFIG_ZONE_SIZE]; // serial, revision, locks, SlotConfig, KeyConfig
+	uint16_t publicKeySlot; // PUBLIC_KEY_CACHE_EMPTY if no key was kept
+	uint8_t publicKey[PUBLIC_KEY_SIZE];
+	uint8_t crc[CRC_SIZE]; // over everything above
+};
+
+// Discovery, see discover()
+#define DISCOVER_FIRST_ADDRESS	0x08 // the whole non-reserved 7-bit range, unless you give a candidate list
+#define DISCOVER_LAST_ADDRESS	0x77
+
+// One IC found by discover()
+struct ATECCX08A_DeviceInfo {
+	uint8_t address; // 7-bit I2C address, ready for begin()
+	uint8_t serialNumber[9]; // all zeros if the config zone could not be read
+	uint8_t revisionNumber[4];
+};
+
 class ATECCX08A {
   public:
 
@@ -197,6 +385,12 @@ class ATECCX08A {
 	boolean begin(uint8_t i2caddr = ATECC508A_ADDRESS_DEFAULT, TwoWire &wirePort = Wire, Stream &serialPort = SerialUSB);  // SamD21 boards
 	#endif
 
+	// Start several ICs at once (begin(), getInfo() and readConfigZone() on each), see beginPool() in .cpp
+	static uint8_t beginPool(ATECCX08A *devices, uint8_t count, const uint8_t *addresses, TwoWire **wirePorts = NULL, boolean *ready = NULL);
+
+	// Find every ATECC on the bus with a single wake pulse, see discover() in .cpp
+	uint8_t discover(ATECCX08A_DeviceInfo *found, uint8_t maxFound, TwoWire &wirePort = Wire, const uint8_t *candidates = NULL, uint8_t candidateCount = 0);
+
 	byte inputBuffer[BUFFER_SIZE]; // used to store messages received from the IC as they come in
 	byte configZone[CONFIG_ZONE_SIZE]; // used to store configuration zone bytes read from device EEPROM
 	uint8_t revisionNumber[5]; // used to store the complete revision number, pulled from configZone[4-7]
@@ -216,11 +410,64 @@ class ATECCX08A {
 	uint8_t countGlobal = 0; // used to add up all the bytes on a long message. Important to reset before each new receiveMessageData();
 	void cleanInputBuffer();
 
+	uint8_t lastStatus = ATECC_STATUS_OK; // why the last command failed, when a function returns false
+
+	// Run other (more urgent) work between the commands of long sequences
+	void setYieldCallback(void (*callback)(void *context), void *context = NULL);
+
+	// Stop a long operation at the next command boundary
+	void cancel();
+	boolean tempKeyValid = false; // our model of the IC: does TempKey hold a value loaded with loadTempKey()/loadTempKeyRandom()?
+
+	// Deadline for the following operations (millis() time)
+	void setDeadline(unsigned long deadline);
+	void clearDeadline();
+	static uint8_t executionTime(uint8_t opcode);
+
 	boolean wakeUp();
 	void idleMode();
+	void sleepMode();
+
+	// Recovery from a wedged bus (SDA held low, e.g. after a brownout mid-transfer)
+	void setBusRecoveryPins(uint8_t sdaPin, uint8_t sclPin, uint32_t clockSpeed = 0); // also turns on automatic recovery when a wake or write fails
+	boolean recoverBus();
+	uint32_t busRecoveryCount = 0; // successful recoveries
+	uint32_t busRecoveryFailures = 0;
+	uint32_t busRecoveryMillis = 0; // total time spent in successful recoveries (divide by busRecoveryCount for the mean)
+	boolean beginSession(); // keep the IC awake across several commands, see beginSession() in .cpp
+	void endSession();
+
+	// Optional bus lock, shared with other processes/tasks using the same I2C bus (e.g. flock() on Linux)
+	void setBusLock(boolean (*lock)(void *context), void (*unlock)(void *context), void *context = NULL);
+	uint32_t busLockCount = 0; // number of times the lock was taken
+	uint32_t busLockMicros = 0; // total time spent waiting in the lock callback
+
+	// Optional latency histogram per command (microseconds, from sendCommand() until the response is read)
+	void setLatencyHistogram(uint8_t opcode, ATECCX08A_Histogram *histogram);
+	static uint8_t opcodeIndex(uint8_t opcode);
+
+	// Optional energy accounting per power state and per command
+	void setEnergyStats(ATECCX08A_EnergyStats *stats);
+	void setCurrentModel(uint32_t activeNanoamps, uint32_t idleNanoamps, uint32_t sleepNanoamps, uint16_t supplyMillivolts);
+	float energyPerCommand(uint8_t opcode); // average uJ per command
+	float energyTotal(); // uJ in all states since setEnergyStats()
+
+	// Optional duty-cycle limiter on IC active time, per class of command
+	void setDutyBudget(uint8_t dutyClass, ATECCX08A_DutyBudget *budget, uint16_t msPerSecond = 500, uint16_t burstMs = 250, uint8_t policy = DUTY_POLICY_WAIT);
+	float dutyUtilization(uint8_t dutyClass); // 0.0 - 1.0 of wall time spent active since setDutyBudget()
+	static uint8_t dutyClass(uint8_t opcode);
+
+	#ifdef ATECCX08A_FAULT_INJECTION
+	// Optional fault injection, to test retries, recovery and deadlines without flaky hardware
+	void setFaultInjection(ATECCX08A_Fault *faults, uint8_t faultCount, uint32_t seed = 1);
+	#endif
+
+	// Optional tracing of every protocol phase
+	void setTraceCallback(void (*callback)(const ATECCX08A_TraceEvent *event, void *context), void *context = NULL);
 	boolean getInfo();
 	boolean writeConfigSparkFun();
 	boolean lockConfig(); // note, this PERMINANTLY disables changes to config zone - including changing the I2C address!
+	boolean setI2CAddress(uint8_t newAddress); // before lockConfig(), moves the IC (and this instance) to a new address
 	boolean lockDataAndOTP();
 	boolean lockDataSlot0();
 	boolean lock(uint8_t zone);
@@ -234,8 +481,20 @@ class ATECCX08A {
 	long random(long max);
 	long random(long min, long max);
 
+	void setRandomSeedPolicy(uint8_t policy);
+
+	// Optional random pool, refilled from the main loop and safe to read inside an interrupt
+	void setRandomPool(uint8_t *buffer, uint8_t size);
+	boolean refillRandomPool(boolean debug = false);
+	boolean tryGetRandom(uint8_t *value);
+	uint8_t randomPoolAvailable();
+
 	// SHA256
 	boolean sha256(uint8_t * data, size_t len, uint8_t * hash);
+	boolean sha256Start();
+	boolean sha256Update(uint8_t * data, size_t len);
+	boolean sha256End(uint8_t * hash);
+	boolean sha256Chain(uint8_t * previousHash, uint8_t * data, size_t len, uint8_t * hash); // hash = SHA256(previousHash || data), for hash-chained logs
 
 	uint8_t crc[CRC_SIZE] = {0, 0};
 	void atca_calculate_crc(uint8_t length, uint8_t *data);
@@ -245,15 +504,41 @@ class ATECCX08A {
 	boolean generatePublicKey(uint16_t slot = 0x0000, boolean debug = true);
 
 	boolean createSignature(uint8_t *data, uint16_t slot = 0x0000);
+	boolean signWithSlots(uint8_t *data, uint16_t *slots, uint8_t count, uint8_t *signatures); // signatures must hold count * 64 bytes
 	boolean loadTempKey(uint8_t *data);  // load 32 bytes of data into tempKey (a temporary memory spot in the IC)
+	boolean loadTempKeyRandom(uint8_t *numIn, boolean debug = false); // NONCE random mode, 32 byte RandOut ends up in random32Bytes[]
 	boolean signTempKey(uint16_t slot = 0x0000); // create signature using contents of TempKey and PRIVATE KEY in slot
+
+	// Non-blocking signature: start it, do other work while the IC computes (~60ms), then finish it
+	boolean createSignatureStart(uint8_t *data, uint16_t slot = 0x0000);
+	boolean signatureReady();
+	boolean createSignatureFinish();
 	boolean verifySignature(uint8_t *message, uint8_t *signature, uint8_t *publicKey); // external ECC publicKey only
 
+	uint8_t sharedSecret[SHARED_SECRET_SIZE]; // used to store the pre-master secret returned by ECDH()
+	boolean ECDH(uint8_t *publicKey, uint16_t slot = 0x0000);
+
+	// Verification cache (optional, off until you hand it some memory)
+	void setVerifyCache(ATECCX08A_VerifyCacheEntry *entries, uint8_t count);
+	void clearVerifyCache();
+	uint32_t verifyCacheHits = 0;
+	uint32_t verifyCacheMisses = 0;
+
 	boolean read(uint8_t zone, uint16_t address, uint8_t length, boolean debug = false);
 	boolean read_output(uint8_t zone, uint16_t address, uint8_t length, uint8_t * output, boolean debug = false);
 	boolean write(uint8_t zone, uint16_t address, uint8_t *data, uint8_t length_of_data);
 
 	boolean readConfigZone(boolean debug = true);
+	void invalidateCache(); // forget remembered INFO, config zone and public key
+
+	// Fast boot: keep what readConfigZone() and generatePublicKey() found in host NVM
+	boolean saveBootCache(ATECCX08A_BootCache *cache);
+	boolean restoreBootCache(const ATECCX08A_BootCache *cache); // right after begin()
+
+	// Key inventory, decoded from KeyConfig[] (call readConfigZone() first, no extra bus traffic)
+	uint8_t keyType(uint8_t slot);
+	uint16_t eccPrivateKeySlots(); // bit n set = slot n holds an ECC private key
+	uint16_t publicKeySlots(); // bit n set = generatePublicKey(n) is allowed
 	boolean sendCommand(uint8_t command_opcode, uint8_t param1, uint16_t param2, uint8_t *data = NULL, size_t length_of_data = 0);
 
   private:
@@ -262,8 +547,122 @@ class ATECCX08A {
 
 	uint8_t _i2caddr;
 
+	uint8_t _responseLength = 0; // bytes asked for by the last receiveResponseData(), see checkCount()
+
 	Stream *_debugSerial; //The generic connection to user's chosen serial hardware
 
+	uint8_t _sdaPin = BUS_RECOVERY_NO_PIN;
+	uint8_t _sclPin = BUS_RECOVERY_NO_PIN;
+	uint32_t _busClock = 0; // to restore after recoverBus() restarts the port, 0 = leave the default
+	boolean _recovering = false;
+	boolean wakePulse();
+	void clearBus();
+
+	uint8_t _sessionDepth = 0; // nested beginSession() calls
+	boolean _awake = false; // true from a successful wakeUp() until the next idle
+	unsigned long _wakeTime = 0; // millis() at the last successful wakeUp()
+	void enterIdle();
+
+	boolean (*_busLock)(void *context) = NULL;
+	void (*_busUnlock)(void *context) = NULL;
+	void *_busLockContext = NULL;
+	boolean _busLocked = false;
+	boolean acquireBus();
+	void releaseBus();
+
+	void (*_traceCallback)(const ATECCX08A_TraceEvent *event, void *context) = NULL;
+	void *_traceContext = NULL;
+	uint8_t _traceOpcode = 0;
+	boolean _traceCommandSpan = false; // a single command's TRACE_PHASE_SESSION is open
+	uint16_t _traceParam2 = 0;
+	void trace(uint8_t phase, boolean begin);
+	void endCommandSpan();
+
+	void executionWait(unsigned long ms);
+
+	void (*_yieldCallback)(void *context) = NULL;
+	void *_yieldContext = NULL;
+	boolean _yielding = false;
+	volatile boolean _cancelRequested = false;
+	uint16_t _tempKeyEpoch = 0; // changes every time TempKey is replaced (NONCE, SHA start)
+	boolean commandBoundary();
+	boolean cancelled();
+
+	boolean _infoCached = false;
+	unsigned long _infoTime = 0;
+	boolean _configZoneCached = false; // only once config and data are locked
+	boolean readConfigZoneFromDevice();
+	void useConfigZone(const uint8_t *newConfigZone);
+	boolean _poolReady = false; // still on track during beginPool()
+	ATECCX08A *_poolBusOwner = NULL; // during beginPool(), the earlier IC on the same bus whose lock we share
+	static void poolExecutionWait(ATECCX08A *devices, uint8_t count, unsigned long ms);
+
+	#ifdef ATECCX08A_FAULT_INJECTION
+	ATECCX08A_Fault *_faults = NULL;
+	uint8_t _faultCount = 0;
+	uint32_t _faultRandom = 1; // LCG state, for probabilities
+	uint16_t _faultResponse = 0; // responses seen since setFaultInjection()
+	uint8_t _faultNackPolls = 0;
+	uint8_t _faultHangWakes = 0;
+	boolean _faultSleep = false;
+	uint8_t _faultCorrupt = 0; // bit per FAULT_ type, for the response being read
+	uint8_t _faultTruncate = 0;
+	void injectFaults();
+	void corruptResponse();
+	#endif
+	uint8_t _publicKeyCache[PUBLIC_KEY_SIZE];
+	uint16_t _publicKeyCacheSlot = PUBLIC_KEY_CACHE_EMPTY;
+	boolean generatePublicKeyFromDevice(uint16_t slot);
+	boolean publicKeyFixed(uint16_t slot);
+
+	unsigned long _deadline = 0;
+	boolean _deadlineSet = false;
+	boolean deadlineAllows(unsigned long ms);
+
+	ATECCX08A_Histogram *_latencyHistograms[OPCODE_INDEX_COUNT] = {};
+	unsigned long _commandStart = 0; // micros() when the current command was sent
+	boolean _commandTiming = false; // the next response read ends the current command
+
+	ATECCX08A_EnergyStats *_energyStats = NULL;
+	uint32_t _currentNanoamps[3] = {150, 800000, 14000000}; // sleep, idle, active; see setCurrentModel()
+	uint16_t _supplyMillivolts = 3300;
+	uint8_t _powerState = POWER_STATE_SLEEP;
+	unsigned long _powerStateMicros = 0; // micros() and millis() when _powerState was entered
+	unsigned long _powerStateMillis = 0;
+	void setPowerState(uint8_t state);
+
+	ATECCX08A_DutyBudget *_dutyBudgets[DUTY_CLASS_COUNT] = {};
+	boolean dutyAllows(uint8_t opcode);
+
+	boolean verifyTempKey(uint8_t *signature, uint8_t *publicKey);
+	boolean receiveSignature();
+
+	boolean _signaturePending = false; // a SIGN command was sent by createSignatureStart()
+	unsigned long _signatureStart = 0; // millis() when it was sent
+	uint8_t _signatureTime = 0; // execution time to wait for
+
+	uint8_t _shaBlock[SHA_BLOCK_SIZE]; // partial block held between sha256Update() calls
+	uint8_t _shaBlockLength = 0;
+	boolean shaCommand(uint8_t mode, uint8_t * data, uint8_t length);
+
+	uint8_t _randomSeedPolicy = RANDOM_SEED_UPDATE_ALWAYS;
+	boolean _randomSeedUpdated = false; // has the EEPROM seed been updated since the IC last woke from sleep?
+	uint8_t randomMode();
+
+	// single producer (refillRandomPool) / single consumer (tryGetRandom) ring buffer.
+	// head and tail run freely from 0-255, only the producer writes head and only the consumer writes tail.
+	volatile uint8_t *_randomPool = NULL;
+	uint8_t _randomPoolSize = 0; // a power of 2
+	volatile uint8_t _randomPoolHead = 0;
+	volatile uint8_t _randomPoolTail = 0;
+
+	ATECCX08A_VerifyCacheEntry *_verifyCache = NULL;
+	uint8_t _verifyCacheCount = 0;
+	uint32_t _verifyCacheClock = 0;
+	uint32_t verifyCacheTag(uint8_t *message, uint8_t *signature, uint8_t *publicKey);
+	ATECCX08A_VerifyCacheEntry *verifyCacheFind(uint32_t tag, uint8_t *message, uint8_t *signature, uint8_t *publicKey);
+	void verifyCacheInsert(uint32_t tag, uint8_t *message, uint8_t *signature, uint8_t *publicKey);
+
 };
 
 